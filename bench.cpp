@@ -0,0 +1,369 @@
+// headless benchmark of the launcher UI: draws synthetic IOC lists and logs
+// without a display or GL context and reports the CPU time of the frames
+// and the size of the draw data, per scenario
+//
+//   gen2oll-bench [-i iocs] [-l log MB] [-f frames] [-s scenario] [-p p99 ms]
+//
+// with -p the exit status is 1 if the p99 frame time of any scenario is
+// over the limit
+
+#include "launcher.h"
+#include "imgui_internal.h"
+
+#include <stdio.h>
+#include <getopt.h>
+
+struct BenchOptions {
+    size_t iocs;
+    double logMB;
+    int frames;
+    const char * scenario;
+    double limit;
+};
+
+struct BenchScenario {
+    const char * name;
+    const char * info;
+    // set up the state before the first frame
+    void (*setup)(IocList * _iocs, BenchOptions & _options);
+    // called before every frame
+    void (*step)(IocList * _iocs, int _frame);
+};
+
+static void addIocs(IocList * _iocs, size_t _count) {
+    for (size_t n = 0; n < _count; n++) {
+        char stage[64], path[128], name[32], device[32], prefix[64];
+        snprintf(stage, sizeof(stage), "/bench/stage%zu", n % 50);
+        snprintf(name, sizeof(name), "ioc%zu", n);
+        snprintf(path, sizeof(path), "%s/iocs/%s", stage, name);
+        // not in the order they are listed in
+        snprintf(device, sizeof(device), "CAM%05zu", (n * 7919) % _count);
+        snprintf(prefix, sizeof(prefix), "LAB:SEC%zu:CAM%zu:", n % 17, (n * 104729) % _count);
+        _iocs->addIoc(new Ioc(stage, path, name, device, prefix));
+    }
+}
+
+// typical areaDetector IOC chatter, some of it in color
+static void addLog(ChildData & _data, double _mb) {
+    static const char * lines[] = {
+        "2020/11/03 10:21:%02d.%03d CAM%05zu:cam1: acquire period 0.100 s, exposure 0.050 s\n",
+        "2020/11/03 10:21:%02d.%03d CAM%05zu:image1: array callback, %zu bytes\n",
+        "2020/11/03 10:21:%02d.%03d CAM%05zu:Stats1: mean 1234.5 sigma 12.3 min 2 max 4095 %zu\n",
+        "2020/11/03 10:21:%02d.%03d CAM%05zu: \x1b[1;31mepicsThreadOnce: pthread_mutex_lock failed\x1b[0m %zu\n",
+    };
+    size_t bytes = _mb * 1024 * 1024;
+    size_t added = 0;
+    for (size_t n = 0; added < bytes; n++) {
+        char line[256];
+        added += snprintf(line, sizeof(line), lines[n % 4], (int)(n / 1000 % 60), (int)(n % 1000), n % 100, n);
+        _data.addLine(line);
+    }
+}
+
+// mouse over the center of a window, the first one whose name contains _name
+static void hoverWindow(const char * _name) {
+    ImGuiContext & g = *ImGui::GetCurrentContext();
+    for (int n = 0; n < g.Windows.Size; n++) {
+        ImGuiWindow * window = g.Windows[n];
+        if (strstr(window->Name, _name)) {
+            ImGui::GetIO().MousePos = window->Rect().GetCenter();
+            return;
+        }
+    }
+}
+
+static void setupList(IocList * _iocs, BenchOptions & _options) {
+    addIocs(_iocs, _options.iocs);
+}
+
+static void stepScroll(IocList *, int _frame) {
+    hoverWindow("iocrows");
+    // down a bit every frame, jump back to the top now and then
+    ImGui::GetIO().MouseWheel = (_frame % 100 == 99) ? 1000.0f : -3.0f;
+}
+
+static void stepFilter(IocList * _iocs, int _frame) {
+    // typing and deleting a filter, one key per frame
+    static const char * text = "sec1:cam1";
+    size_t len = strlen(text);
+    size_t pos = _frame % (2 * len);
+    size_t typed = (pos < len) ? pos + 1 : 2 * len - pos - 1;
+    ImGuiTextFilter & filter = _iocs->table.filter;
+    memcpy(filter.InputBuf, text, typed);
+    filter.InputBuf[typed] = '\0';
+    filter.Build();
+}
+
+static void stepSort(IocList * _iocs, int _frame) {
+    _iocs->table.sortBy(IOC_COLUMN_NAME + _frame % 3);
+}
+
+static void stepChurn(IocList * _iocs, int _frame) {
+    // IOCs coming and going, as when a stage is edited
+    char path[128];
+    snprintf(path, sizeof(path), "/bench/churn/iocs/ioc%d", _frame);
+    char device[32];
+    snprintf(device, sizeof(device), "CHURN%05d", _frame);
+    char prefix[64];
+    snprintf(prefix, sizeof(prefix), "LAB:CHURN%d:", _frame);
+    _iocs->addIoc(new Ioc("/bench/churn", path, "churn", device, prefix));
+    if (_frame > 10) {
+        snprintf(path, sizeof(path), "/bench/churn/iocs/ioc%d", _frame - 10);
+        _iocs->removeIocs(path);
+    }
+}
+
+static void setupLog(IocList * _iocs, BenchOptions & _options) {
+    addIocs(_iocs, 1);
+    Ioc * ioc = _iocs->ioc(0);
+    ioc->open = true;
+    addLog(ioc->childStdout, _options.logMB);
+    addLog(ioc->childStderr, _options.logMB / 10);
+}
+
+static void stepLogTail(IocList * _iocs, int _frame) {
+    // new output arriving while the view follows it
+    Ioc * ioc = _iocs->ioc(0);
+    char line[128];
+    snprintf(line, sizeof(line), "2020/11/03 10:22:00.%03d CAM00000: frame %d\n", _frame % 1000, _frame);
+    ioc->childStdout.addLine(line);
+}
+
+static void stepLogScroll(IocList * _iocs, int _frame) {
+    Ioc * ioc = _iocs->ioc(0);
+    ioc->childStdout.autoScroll = false;
+    hoverWindow("OutLog");
+    ImGui::GetIO().MouseWheel = (_frame % 100 == 99) ? 100000.0f : -3.0f;
+}
+
+static void setupCompact(IocList * _iocs, BenchOptions & _options) {
+    addIocs(_iocs, 1);
+    Ioc * ioc = _iocs->ioc(0);
+    ioc->open = true;
+    ioc->childStdout.setCompact(true);
+    ioc->childStderr.setCompact(true);
+    addLog(ioc->childStdout, _options.logMB);
+    addLog(ioc->childStderr, _options.logMB / 10);
+}
+
+static void setupOnePane(IocList * _iocs, BenchOptions & _options) {
+    setupLog(_iocs, _options);
+    _iocs->ioc(0)->combined = true;
+}
+
+static void stepOnePane(IocList * _iocs, int _frame) {
+    Ioc * ioc = _iocs->ioc(0);
+    ioc->childStdout.autoScroll = false;
+    hoverWindow("AllLog");
+    ImGui::GetIO().MouseWheel = (_frame % 100 == 99) ? 100000.0f : -3.0f;
+}
+
+static void stepSearch(IocList * _iocs, int _frame) {
+    // typing and deleting a search, one key per frame, as text and as regex
+    static const char * texts[] = { "cam00042:stats1: mean", "CAM0004[0-9]:image1: .* 1234[0-9]+ bytes" };
+    ChildData & data = _iocs->ioc(0)->childStdout;
+    const char * text = texts[_frame / 100 % 2];
+    size_t len = strlen(text);
+    size_t pos = _frame % 100 % (2 * len);
+    size_t typed = (pos < len) ? pos + 1 : 2 * len - pos - 1;
+    snprintf(data.searchText, sizeof(data.searchText), "%.*s", (int)typed, text);
+    data.searchRegex = _frame / 100 % 2;
+    data.search();
+    data.nextMatch(1);
+}
+
+static void stepLogFilter(IocList * _iocs, int _frame) {
+    // typing and deleting a filter while new output comes in
+    static const char * text = "cam00042:stats1: mean";
+    ChildData & data = _iocs->ioc(0)->childStdout;
+    size_t len = strlen(text);
+    size_t pos = _frame % (2 * len);
+    size_t typed = (pos < len) ? pos + 1 : 2 * len - pos - 1;
+    snprintf(data.filterText, sizeof(data.filterText), "%.*s", (int)typed, text);
+    data.filter();
+    stepLogTail(_iocs, _frame);
+}
+
+// 20 IOCs taking turns, a few ms apart, in the timeline
+static void setupTimeline(IocList * _iocs, BenchOptions & _options) {
+    addIocs(_iocs, 20);
+    for (size_t n = 0; n < 20; n++) {
+        Ioc * ioc = _iocs->ioc(n);
+        _iocs->timeline.add(ioc, (n % 4 == 3) ? &ioc->childStderr : &ioc->childStdout);
+        // the lines differ only in numbers, they would be collapsed
+        ioc->childStdout.collapseRepeats = false;
+        ioc->childStderr.collapseRepeats = false;
+    }
+    _iocs->timeline.open = true;
+    size_t bytes = _options.logMB * 1024 * 1024;
+    uint64_t mono = logTime();
+    size_t size = 0;
+    for (size_t n = 0; size < bytes; n++) {
+        char line[128];
+        snprintf(line, sizeof(line), "2020/11/03 10:21:%02d.%03d CAM%05zu:cam1: frame %zu\n", (int)(n / 1000 % 60), (int)(n % 1000), n % 20, n);
+        mono += n * 7919 % 3000;
+        _iocs->timeline.sources[n * 13 % 20].data->addLine(line, mono);
+        size += strlen(line);
+    }
+}
+
+static void stepTimeline(IocList * _iocs, int _frame) {
+    _iocs->timeline.follow = false;
+    hoverWindow("timelinerows");
+    // scroll a bit, now and then jump to the top, far down or to the end
+    static const float jumps[] = { 1e9f, -3e4f, -1e9f };
+    ImGui::GetIO().MouseWheel = (_frame % 100 == 99) ? jumps[_frame / 100 % 3] : -3.0f;
+}
+
+static BenchScenario scenarios[] = {
+    { "list",       "IOC table, nothing going on",          setupList,  NULL },
+    { "scroll",     "IOC table, scrolling",                 setupList,  stepScroll },
+    { "filter",     "IOC table, typing a filter",           setupList,  stepFilter },
+    { "sort",       "IOC table, sorting by another column", setupList,  stepSort },
+    { "churn",      "IOC table, IOCs added and removed",    setupList,  stepChurn },
+    { "log",        "IOC log, following new output",        setupLog,   stepLogTail },
+    { "logscroll",  "IOC log, scrolling",                   setupLog,   stepLogScroll },
+    { "compact",    "IOC log kept as templates, scrolling", setupCompact, stepLogScroll },
+    { "onepane",    "IOC log, stdout and stderr in one pane", setupOnePane, stepOnePane },
+    { "timeline",   "timeline of 20 IOCs, scrolling",       setupTimeline, stepTimeline },
+    { "search",     "IOC log, typing a search",             setupLog,   stepSearch },
+    { "logfilter",  "IOC log, typing a filter",             setupLog,   stepLogFilter },
+};
+
+static double percentile(std::vector<double> & _values, int _pct) {
+    std::sort(_values.begin(), _values.end());
+    return _values[(_values.size() - 1) * _pct / 100];
+}
+
+// frame times in ms; returns the p99
+static double runScenario(BenchScenario & _scenario, BenchOptions & _options) {
+    ImGui::CreateContext();
+    ImGuiIO & io = ImGui::GetIO();
+    io.DisplaySize = ImVec2(1920, 1080);
+    io.DeltaTime = 1.0f / 60.0f;
+    io.IniFilename = NULL;
+    // the font atlas would be a texture upload, building it is enough
+    unsigned char * pixels;
+    int width, height;
+    io.Fonts->GetTexDataAsRGBA32(&pixels, &width, &height);
+
+    IocList * iocs = new IocList();
+    iocs->loadSeverity();
+    _scenario.setup(iocs, _options);
+
+    std::vector<double> newFrame, draw, render, total;
+    size_t vertices = 0, indices = 0, commands = 0;
+    // a few frames for the windows to settle and the caches to fill
+    int warmup = 10;
+    for (int frame = 0; frame < warmup + _options.frames; frame++) {
+        if (_scenario.step) {
+            _scenario.step(iocs, frame);
+        }
+        double t0 = launcherTime();
+        ImGui::NewFrame();
+        double t1 = launcherTime();
+        ImGui::SetNextWindowPos(ImVec2(0, 0), ImGuiCond_FirstUseEver);
+        ImGui::SetNextWindowSize(ImVec2(1200, 1080), ImGuiCond_FirstUseEver);
+        launcherDraw(iocs);
+        double t2 = launcherTime();
+        ImGui::Render();
+        double t3 = launcherTime();
+        io.MouseWheel = 0.0f;
+
+        if (frame < warmup) {
+            continue;
+        }
+        newFrame.push_back((t1 - t0) * 1e3);
+        draw.push_back((t2 - t1) * 1e3);
+        render.push_back((t3 - t2) * 1e3);
+        total.push_back((t3 - t0) * 1e3);
+        ImDrawData * drawData = ImGui::GetDrawData();
+        vertices += drawData->TotalVtxCount;
+        indices += drawData->TotalIdxCount;
+        for (int n = 0; n < drawData->CmdListsCount; n++) {
+            commands += drawData->CmdLists[n]->CmdBuffer.Size;
+        }
+    }
+
+    double p50 = percentile(total, 50);
+    double p90 = percentile(total, 90);
+    double p99 = percentile(total, 99);
+    double max = percentile(total, 100);
+    printf("%-10s %8.3f %8.3f %8.3f %8.3f  %7.3f %7.3f %7.3f  %8zu %8zu %6zu  %s\n", _scenario.name,
+        p50, p90, p99, max,
+        percentile(newFrame, 50), percentile(draw, 50), percentile(render, 50),
+        vertices / total.size(), indices / total.size(), commands / total.size(), _scenario.info);
+
+    delete iocs;
+    ImGui::DestroyContext();
+    return p99;
+}
+
+static void usage(const char * _name) {
+    fprintf(stderr, "usage: %s [-i iocs] [-l log MB] [-f frames] [-s scenario] [-p p99 ms]\n", _name);
+    fprintf(stderr, "scenarios:\n");
+    for (size_t n = 0; n < IM_ARRAYSIZE(scenarios); n++) {
+        fprintf(stderr, "  %-10s %s\n", scenarios[n].name, scenarios[n].info);
+    }
+}
+
+int main(int argc, char ** argv) {
+    BenchOptions options;
+    options.iocs = 5000;
+    options.logMB = 8;
+    options.frames = 300;
+    options.scenario = NULL;
+    options.limit = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "i:l:f:s:p:h")) != -1) {
+        switch (opt) {
+        case 'i':
+            options.iocs = strtoul(optarg, NULL, 10);
+            break;
+        case 'l':
+            options.logMB = atof(optarg);
+            break;
+        case 'f':
+            options.frames = atoi(optarg);
+            break;
+        case 's':
+            options.scenario = optarg;
+            break;
+        case 'p':
+            options.limit = atof(optarg);
+            break;
+        default:
+            usage(argv[0]);
+            return 2;
+        }
+    }
+    if (options.iocs < 1 || options.frames < 1) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    bool found = false;
+    for (size_t n = 0; n < IM_ARRAYSIZE(scenarios); n++) {
+        found = found || ! options.scenario || strcmp(options.scenario, scenarios[n].name) == 0;
+    }
+    if (! found) {
+        usage(argv[0]);
+        return 2;
+    }
+
+    printf("%zu IOCs, %.1f MB log, %d frames\n", options.iocs, options.logMB, options.frames);
+    printf("%-10s %8s %8s %8s %8s  %7s %7s %7s  %8s %8s %6s\n", "scenario",
+        "p50 ms", "p90 ms", "p99 ms", "max ms", "new", "draw", "render", "vertices", "indices", "cmds");
+    bool over = false;
+    for (size_t n = 0; n < IM_ARRAYSIZE(scenarios); n++) {
+        if (options.scenario && strcmp(options.scenario, scenarios[n].name) != 0) {
+            continue;
+        }
+        double p99 = runScenario(scenarios[n], options);
+        if (options.limit > 0 && p99 > options.limit) {
+            over = true;
+        }
+    }
+    return over ? 1 : 0;
+}
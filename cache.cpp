@@ -0,0 +1,221 @@
+#include "launcher.h"
+
+#include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+
+// on-disk discovery cache layout:
+//   IocCacheHeader
+//   IocCacheEntry[count]
+//   string table, NUL terminated strings referenced by offset
+// file is written in native byte order and read with mmap()
+
+#define CACHE_MAGIC             "G2OLLIC"
+#define CACHE_VERSION           2
+
+struct IocCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t entrySize;
+    uint32_t count;
+    uint32_t stringsSize;
+};
+
+struct IocCacheEntry {
+    uint32_t stagePath;
+    uint32_t instancePath;
+    uint32_t instanceName;
+    uint32_t deviceName;
+    uint32_t prefix;
+    uint32_t root;
+    uint64_t dev;
+    uint64_t ino;
+    int64_t dirMtimeSec;
+    int64_t dirMtimeNsec;
+    int64_t cmdMtimeSec;
+    int64_t cmdMtimeNsec;
+};
+
+// $_xdg/gen2oll or ~/_home/gen2oll, for example $XDG_CACHE_HOME/gen2oll or
+// ~/.cache/gen2oll
+bool launcherUserDir(const char * _xdg, const char * _home, char * _dir, size_t _size, bool _create) {
+    const char * xdg = getenv(_xdg);
+    const char * home = getenv("HOME");
+    if (xdg && strlen(xdg)) {
+        snprintf(_dir, _size, "%s/gen2oll", xdg);
+    } else if (home && strlen(home)) {
+        snprintf(_dir, _size, "%s/%s/gen2oll", home, _home);
+    } else {
+        return false;
+    }
+    if (_create) {
+        // create missing parents, too
+        for (char * p = _dir + 1; *p; p++) {
+            if (*p == '/') {
+                *p = '\0';
+                mkdir(_dir, 0755);
+                *p = '/';
+            }
+        }
+        if (mkdir(_dir, 0755) != 0 && errno != EEXIST) {
+            E("mkdir() %s failed %s\n", _dir, strerror(errno));
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool cachePath(char * _path, size_t _size, bool _create) {
+    char dir[512];
+    if (! launcherUserDir("XDG_CACHE_HOME", ".cache", dir, sizeof(dir), _create)) {
+        return false;
+    }
+    snprintf(_path, _size, "%s/iocs.cache", dir);
+    return true;
+}
+
+static uint32_t addString(std::vector<char> & _strings, const char * _str) {
+    uint32_t offset = _strings.size();
+    _strings.insert(_strings.end(), _str, _str + strlen(_str) + 1);
+    return offset;
+}
+
+bool IocList::saveCache(void) {
+    char path[1024];
+    char tmpPath[1040];
+    if (! cachePath(path, sizeof(path), true)) {
+        return false;
+    }
+
+    IocCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, CACHE_MAGIC, sizeof(CACHE_MAGIC));
+    header.version = CACHE_VERSION;
+    header.entrySize = sizeof(IocCacheEntry);
+    header.count = list.size();
+
+    std::vector<IocCacheEntry> entries(list.size());
+    std::vector<char> strings;
+    for (size_t n = 0; n < list.size(); n++) {
+        Ioc * ioc = list[n];
+        IocCacheEntry & entry = entries[n];
+        memset(&entry, 0, sizeof(entry));
+        entry.stagePath = addString(strings, ioc->stagePath);
+        entry.instancePath = addString(strings, ioc->instancePath);
+        entry.instanceName = addString(strings, ioc->instanceName);
+        entry.deviceName = addString(strings, ioc->deviceName);
+        entry.prefix = addString(strings, ioc->prefix);
+        entry.root = addString(strings, ioc->root ? ioc->root->path : "");
+        entry.dev = ioc->dev;
+        entry.ino = ioc->ino;
+        entry.dirMtimeSec = ioc->dirMtime.tv_sec;
+        entry.dirMtimeNsec = ioc->dirMtime.tv_nsec;
+        entry.cmdMtimeSec = ioc->cmdMtime.tv_sec;
+        entry.cmdMtimeNsec = ioc->cmdMtime.tv_nsec;
+    }
+    header.stringsSize = strings.size();
+
+    // write to a temporary file first, other launchers might be reading it
+    snprintf(tmpPath, sizeof(tmpPath), "%s.%d", path, getpid());
+    FILE * fp = fopen(tmpPath, "wb");
+    if (! fp) {
+        E("fopen() %s failed %s\n", tmpPath, strerror(errno));
+        return false;
+    }
+    bool ok = fwrite(&header, sizeof(header), 1, fp) == 1;
+    if (ok && entries.size()) {
+        ok = fwrite(entries.data(), sizeof(IocCacheEntry), entries.size(), fp) == entries.size();
+    }
+    if (ok && strings.size()) {
+        ok = fwrite(strings.data(), 1, strings.size(), fp) == strings.size();
+    }
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    if (! ok || rename(tmpPath, path) != 0) {
+        E("writing %s failed %s\n", path, strerror(errno));
+        unlink(tmpPath);
+        return false;
+    }
+
+    D("saved %zu IOCs to %s\n", entries.size(), path);
+    return true;
+}
+
+bool IocList::loadCache(void) {
+    char path[1024];
+    if (! cachePath(path, sizeof(path), false)) {
+        return false;
+    }
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        D("no cache %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(IocCacheHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void * map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        E("mmap() %s failed %s\n", path, strerror(errno));
+        return false;
+    }
+
+    const char * data = (const char *)map;
+    const IocCacheHeader * header = (const IocCacheHeader *)data;
+    size_t stringsStart = sizeof(IocCacheHeader) + (size_t)header->count * sizeof(IocCacheEntry);
+    if (memcmp(header->magic, CACHE_MAGIC, sizeof(CACHE_MAGIC)) != 0 ||
+        header->version != CACHE_VERSION ||
+        header->entrySize != sizeof(IocCacheEntry) ||
+        stringsStart + header->stringsSize != size) {
+        D("ignoring stale or foreign cache %s\n", path);
+        munmap(map, size);
+        return false;
+    }
+
+    const IocCacheEntry * entries = (const IocCacheEntry *)(data + sizeof(IocCacheHeader));
+    const char * strings = data + stringsStart;
+    uint32_t stringsSize = header->stringsSize;
+    // all the strings must be within the table and terminated
+    if (stringsSize && strings[stringsSize - 1] != '\0') {
+        munmap(map, size);
+        return false;
+    }
+    for (uint32_t n = 0; n < header->count; n++) {
+        const IocCacheEntry & entry = entries[n];
+        if (entry.stagePath >= stringsSize || entry.instancePath >= stringsSize ||
+            entry.instanceName >= stringsSize || entry.deviceName >= stringsSize ||
+            entry.prefix >= stringsSize || entry.root >= stringsSize) {
+            E("corrupt cache entry %u in %s\n", n, path);
+            break;
+        }
+        // roots might have been removed since
+        IocRoot * root = findRoot(strings + entry.root);
+        if (! root || findIoc(strings + entry.instancePath)) {
+            continue;
+        }
+        Ioc * ioc = new Ioc(strings + entry.stagePath, strings + entry.instancePath,
+            strings + entry.instanceName, strings + entry.deviceName, strings + entry.prefix);
+        ioc->dirMtime.tv_sec = entry.dirMtimeSec;
+        ioc->dirMtime.tv_nsec = entry.dirMtimeNsec;
+        ioc->cmdMtime.tv_sec = entry.cmdMtimeSec;
+        ioc->cmdMtime.tv_nsec = entry.cmdMtimeNsec;
+        ioc->root = root;
+        ioc->dev = entry.dev;
+        ioc->ino = entry.ino;
+        addIoc(ioc);
+        root->iocs++;
+    }
+
+    munmap(map, size);
+    D("loaded %zu IOCs from %s\n", count(), path);
+    return true;
+}
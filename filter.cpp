@@ -0,0 +1,172 @@
+#include "launcher.h"
+
+#include <stdio.h>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// the case bit, or'ed into both sides so that a letter matches either case
+static inline unsigned char caseBit(unsigned char _c) {
+    return (_c >= 'a' && _c <= 'z') ? 0x20 : 0;
+}
+
+static inline bool sameNoCase(const char * _p, const std::string & _text) {
+    for (size_t n = 0; n < _text.size(); n++) {
+        unsigned char c = _p[n];
+        if (c + ((c >= 'A' && c <= 'Z') ? 0x20 : 0) != (unsigned char)_text[n]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// the first and last characters of _text are compared at 16 or 32
+// positions at once, only where both match is the rest compared; with
+// neither SSE2 nor AVX2 (make AVX2=1) it is one position at a time
+const char * logFind(const char * _from, const char * _to, const std::string & _text) {
+    size_t len = _text.size();
+    if (! len || (size_t)(_to - _from) < len) {
+        return NULL;
+    }
+    // last place it can start
+    const char * last = _to - len;
+    unsigned char first = _text[0];
+    unsigned char final = _text[len - 1];
+    const char * p = _from;
+#if defined(__AVX2__)
+    const __m256i firstChar = _mm256_set1_epi8(first);
+    const __m256i firstCase = _mm256_set1_epi8(caseBit(first));
+    const __m256i finalChar = _mm256_set1_epi8(final);
+    const __m256i finalCase = _mm256_set1_epi8(caseBit(final));
+    for (; p + 32 <= last + 1; p += 32) {
+        __m256i a = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)p), firstCase);
+        __m256i b = _mm256_or_si256(_mm256_loadu_si256((const __m256i *)(p + len - 1)), finalCase);
+        unsigned int mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, firstChar), _mm256_cmpeq_epi8(b, finalChar)));
+        while (mask) {
+            const char * at = p + __builtin_ctz(mask);
+            if (sameNoCase(at, _text)) {
+                return at;
+            }
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128i firstChar = _mm_set1_epi8(first);
+    const __m128i firstCase = _mm_set1_epi8(caseBit(first));
+    const __m128i finalChar = _mm_set1_epi8(final);
+    const __m128i finalCase = _mm_set1_epi8(caseBit(final));
+    for (; p + 16 <= last + 1; p += 16) {
+        __m128i a = _mm_or_si128(_mm_loadu_si128((const __m128i *)p), firstCase);
+        __m128i b = _mm_or_si128(_mm_loadu_si128((const __m128i *)(p + len - 1)), finalCase);
+        unsigned int mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, firstChar), _mm_cmpeq_epi8(b, finalChar)));
+        while (mask) {
+            const char * at = p + __builtin_ctz(mask);
+            if (sameNoCase(at, _text)) {
+                return at;
+            }
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; p <= last; p++) {
+        if (((unsigned char)*p | caseBit(first)) == first && sameNoCase(p, _text)) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// new filter text, the lines are looked at again by updateFilter()
+void ChildData::filter(void) {
+    filterNeedle.clear();
+    for (const char * p = filterText; *p; p++) {
+        filterNeedle += (*p >= 'A' && *p <= 'Z') ? *p - 'A' + 'a' : *p;
+    }
+    filtered.clear();
+    filterScanned = 0;
+}
+
+// one line against the filter text and the template cluster
+bool ChildData::filterLine(int _line) {
+    if (filterCluster >= 0 && templates.cluster(lineOffsets[_line]) != filterCluster) {
+        return false;
+    }
+    const char * end;
+    const char * start = lineText(_line, &end);
+    return filterNeedle.empty() || logFind(start, end, filterNeedle);
+}
+
+// the lines not looked at yet, LOG_FILTER_LINES at a time; goes on next
+// frame after _budget seconds, 0 for no limit
+void ChildData::updateFilter(double _budget) {
+    size_t end = lineOffsets.Size;
+    if ((filterNeedle.empty() && filterCluster < 0) || filterScanned >= end) {
+        return;
+    }
+    PROFILE_ZONE_ARG("filter", label);
+    double start = launcherTime();
+    const char * base = linesBuffer.begin();
+    while (filterScanned < end) {
+        size_t line = filterScanned;
+        size_t chunkEnd = std::min(line + LOG_FILTER_LINES, end);
+        if (compact) {
+            // a line at a time, unpacked
+            for (; line < chunkEnd; line++) {
+                if (filterLine(line)) {
+                    filtered.push_back(line);
+                }
+            }
+            filterScanned = chunkEnd;
+            if (_budget > 0.0 && launcherTime() - start > _budget) {
+                break;
+            }
+            continue;
+        }
+        // the text has no newline, what is found is within a line
+        const char * p = base + lineOffsets[line];
+        const char * stop = (chunkEnd < end) ? base + lineOffsets[chunkEnd] : linesBuffer.end();
+        while ((p = logFind(p, stop, filterNeedle))) {
+            line = std::upper_bound(lineOffsets.begin() + line, lineOffsets.begin() + chunkEnd, (int)(p - base)) - lineOffsets.begin() - 1;
+            filtered.push_back(line++);
+            if (line >= chunkEnd) {
+                break;
+            }
+            p = base + lineOffsets[line];
+        }
+        filterScanned = chunkEnd;
+        if (_budget > 0.0 && launcherTime() - start > _budget) {
+            break;
+        }
+    }
+}
+
+// the places of the filter text in a line about to be drawn get a
+// background
+void ChildData::drawFilterMatches(const char * _start, const char * _end) {
+    ImVec2 pos = ImGui::GetCursorScreenPos();
+    float height = ImGui::GetTextLineHeight();
+    ImDrawList * drawList = ImGui::GetWindowDrawList();
+    const char * p = _start;
+    while ((p = logFind(p, _end, filterNeedle))) {
+        float x = pos.x + ImGui::CalcTextSize(_start, p).x;
+        float width = ImGui::CalcTextSize(p, p + filterNeedle.size()).x;
+        drawList->AddRectFilled(ImVec2(x, pos.y), ImVec2(x + width, pos.y + height), IM_COL32(0xa0, 0x80, 0x20, 160));
+        p += filterNeedle.size();
+    }
+}
+
+void ChildData::drawFilter(void) {
+    ImGui::PushItemWidth(200);
+    if (ImGui::InputTextWithHint("##filter", "show only lines with", filterText, IM_ARRAYSIZE(filterText))) {
+        filter();
+    }
+    ImGui::PopItemWidth();
+    // some of a long log every frame, and the lines read since
+    updateFilter(0.01);
+    if (filterNeedle.size() || filterCluster >= 0) {
+        ImGui::SameLine();
+        ImGui::Text("%zu of %d lines%s", filtered.size(), lineOffsets.Size, (filterScanned < (size_t)lineOffsets.Size) ? "+" : "");
+    }
+}
@@ -0,0 +1,160 @@
+#include "launcher.h"
+
+#include <stdio.h>
+#include <algorithm>
+
+static void eraseIoc(std::vector<Ioc *> & _iocs, Ioc * _ioc) {
+    _iocs.erase(std::remove(_iocs.begin(), _iocs.end(), _ioc), _iocs.end());
+}
+
+static std::string inodeKey(dev_t _dev, ino_t _ino) {
+    char key[64];
+    snprintf(key, sizeof(key), "%llx:%llx", (unsigned long long)_dev, (unsigned long long)_ino);
+    return key;
+}
+
+// walk (and grow) the trie along _prefix, adjusting the IOC counts by _delta;
+// returns the node the prefix ends in
+int IocIndex::trieAdd(const char * _prefix, int _delta) {
+    int node = 0;
+    trie[node].subtree += _delta;
+    for (const char * p = _prefix; *p; p++) {
+        int child = trie[node].firstChild;
+        while (child != -1 && trie[child].c != *p) {
+            child = trie[child].nextSibling;
+        }
+        if (child == -1) {
+            // nodes are never freed, empty ones are skipped when searching
+            child = trie.size();
+            trie.push_back(IocTrieNode{*p, -1, trie[node].firstChild, 0, 0});
+            trie[node].firstChild = child;
+        }
+        node = child;
+        trie[node].subtree += _delta;
+    }
+    trie[node].iocs += _delta;
+    return node;
+}
+
+void IocIndex::insert(Ioc * _ioc) {
+    generation++;
+    byPath[_ioc->instancePath] = _ioc;
+    if (_ioc->ino) {
+        byInode[inodeKey(_ioc->dev, _ioc->ino)] = _ioc;
+    }
+    byDevice[_ioc->deviceName].push_back(_ioc);
+    trieAdd(_ioc->prefix, 1);
+
+    std::vector<Ioc *> & same = byPrefix[_ioc->prefix];
+    same.push_back(_ioc);
+    if (same.size() > 1) {
+        if (same.size() == 2) {
+            conflicts++;
+        }
+        E("PV prefix %s of %s already used by %s\n", _ioc->prefix, _ioc->instancePath, same[0]->instancePath);
+        for (size_t n = 0; n < same.size(); n++) {
+            same[n]->prefixConflict = true;
+        }
+    }
+}
+
+void IocIndex::remove(Ioc * _ioc) {
+    auto path = byPath.find(_ioc->instancePath);
+    if (path == byPath.end() || path->second != _ioc) {
+        return;
+    }
+    generation++;
+    byPath.erase(path);
+    if (_ioc->ino) {
+        auto inode = byInode.find(inodeKey(_ioc->dev, _ioc->ino));
+        if (inode != byInode.end() && inode->second == _ioc) {
+            byInode.erase(inode);
+        }
+    }
+
+    auto device = byDevice.find(_ioc->deviceName);
+    if (device != byDevice.end()) {
+        eraseIoc(device->second, _ioc);
+        if (device->second.empty()) {
+            byDevice.erase(device);
+        }
+    }
+
+    trieAdd(_ioc->prefix, -1);
+    auto prefix = byPrefix.find(_ioc->prefix);
+    if (prefix != byPrefix.end()) {
+        std::vector<Ioc *> & same = prefix->second;
+        eraseIoc(same, _ioc);
+        if (same.size() == 1) {
+            // the remaining one is not in conflict any more
+            same[0]->prefixConflict = false;
+            conflicts--;
+        } else if (same.empty()) {
+            byPrefix.erase(prefix);
+        }
+    }
+    _ioc->prefixConflict = false;
+}
+
+Ioc * IocIndex::findInode(dev_t _dev, ino_t _ino) {
+    auto it = byInode.find(inodeKey(_dev, _ino));
+    return (it == byInode.end()) ? NULL : it->second;
+}
+
+void IocIndex::trieCollect(int _node, std::string & _prefix, std::vector<Ioc *> & _matches, size_t _max) {
+    if (_matches.size() >= _max || trie[_node].subtree == 0) {
+        return;
+    }
+    if (trie[_node].iocs) {
+        const std::vector<Ioc *> * iocs = findPrefix(_prefix.c_str());
+        for (size_t n = 0; iocs && n < iocs->size() && _matches.size() < _max; n++) {
+            _matches.push_back((*iocs)[n]);
+        }
+    }
+    for (int child = trie[_node].firstChild; child != -1; child = trie[child].nextSibling) {
+        _prefix.push_back(trie[child].c);
+        trieCollect(child, _prefix, _matches, _max);
+        _prefix.pop_back();
+    }
+}
+
+// look up _text, as typed in the search box, in O(length of _text):
+//  _owners  IOCs whose prefix _text starts with (IOC serving PV _text),
+//           longest prefix first, or the IOCs with device name _text
+//  _matches IOCs whose prefix starts with _text, at most _max
+// returns the number of IOCs with prefix starting with _text
+size_t IocIndex::search(const char * _text, std::vector<Ioc *> & _owners, std::vector<Ioc *> & _matches, size_t _max) {
+    _owners.clear();
+    _matches.clear();
+
+    std::string prefix;
+    int node = 0;
+    for (const char * p = _text; *p && node != -1; p++) {
+        int child = trie[node].firstChild;
+        while (child != -1 && trie[child].c != *p) {
+            child = trie[child].nextSibling;
+        }
+        node = child;
+        if (node == -1) {
+            break;
+        }
+        prefix.push_back(*p);
+        if (trie[node].iocs && p[1] != '\0') {
+            const std::vector<Ioc *> * iocs = findPrefix(prefix.c_str());
+            if (iocs) {
+                _owners.insert(_owners.begin(), iocs->begin(), iocs->end());
+            }
+        }
+    }
+
+    const std::vector<Ioc *> * devices = findDevice(_text);
+    if (devices) {
+        _owners.insert(_owners.end(), devices->begin(), devices->end());
+    }
+
+    if (node == -1) {
+        return 0;
+    }
+    trieCollect(node, prefix, _matches, _max);
+    return trie[node].subtree;
+}
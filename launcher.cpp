@@ -2,6 +2,7 @@
 
 #include <stdio.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <dirent.h>
 #include <errno.h>
 #include <ctype.h>
@@ -14,7 +15,8 @@
 #include <sys/select.h>
 #include <poll.h>
 #include <assert.h>
-#include <libgen.h>
+#include <math.h>
+#include <algorithm>
 
 // we need to traverse this folder structure:
 // lvl0 [root]
@@ -25,9 +27,8 @@
 //
 // we are interested in lvl1 folder path and lvl4 file instance.cmd
 //
-void IocList::listDir(const char * _name, int _level) {
+void IocList::listDir(IocRoot * _root, const char * _name, int _level) {
     DIR * dir;
-    struct dirent * entry;
 
     D("[%d] ENTER %s\n", _level, _name);
 
@@ -35,54 +36,32 @@ void IocList::listDir(const char * _name, int _level) {
         return;
     }
 
-    while ((entry = readdir(dir)) != NULL) {
-        if (entry->d_type == DT_DIR) {
-            // this is a directory we might want to recurse into
-
-            // skip . and .. entries
-            if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
-                continue;
-            }
-
+    // keep an eye on this folder for new / removed stages and instances
+    _root->watcher.add(_name, _level);
 
+    // symlinked stages and file systems that do not report entry types
+    std::vector<IocDirEntry> entries;
+    readDirEntries(dir, entries, NULL);
+    for (size_t n = 0; n < entries.size(); n++) {
+        IocDirEntry * entry = &entries[n];
+        if (entry->type == DT_DIR) {
+            // this is a directory we might want to recurse into
             char path[1024];
-            snprintf(path, sizeof(path), "%s/%s", _name, entry->d_name);
-            D0("[%d] %*s[%s]\n", _level, _level, "", entry->d_name);
-
-            bool recurse = true;
-            if (_level == 0) {
-                // on top level
-                // recurse into all sub-folders
-            } else if (_level == 1) {
-                // on stage level
-                // remember the path
-
-                // recurse only if we have folder called 'ioc'
-                if (strncmp(entry->d_name, "ioc", 3) != 0) {
-                    recurse = false;
-                }
-            } else if (_level == 2) {
-                // recurse into all folders
-            } else if (_level == 3) {
-                // do not recurse into any folders; last level
-                // look for instance.cmd file, see below
-                recurse = false;
-            } else {
-                assert(1 == 0);
-            }
+            snprintf(path, sizeof(path), "%s/%s", _name, entry->name);
+            D0("[%d] %*s[%s]\n", _level, _level, "", entry->name);
 
-            if (recurse) {
+            if (wantDir(entry->name, _level)) {
                 // recurse!
-                listDir(path, _level + 1);
+                listDir(_root, path, _level + 1);
             }
         } else {
             // this is a file
-            D0("[%d] %*s- %s\n", _level, _level, "", entry->d_name);
+            D0("[%d] %*s- %s\n", _level, _level, "", entry->name);
 
             // we are only interested in a instance.cmd file at last level
             if (_level == 3) {
-                if (strncmp(entry->d_name, "instance.cmd", 12) == 0) {
-                    bool ret = parseInstanceFile(_name, entry->d_name);
+                if (strncmp(entry->name, "instance.cmd", 12) == 0) {
+                    bool ret = parseInstanceFile(_root, _name, entry->name);
                     if (! ret) {
                         E("failed to add IOC from instance.cmd in path %s\n", _name);
                     }
@@ -95,153 +74,333 @@ void IocList::listDir(const char * _name, int _level) {
     D("[%d] LEAVE %s\n", _level, _name);
 }
 
-// extract value from lines like 'epicsEnvSet("LOCATION", "LAB")'
-// where LAB is the value to extract
-// value can contain printable characters
-char * IocList::parseInstanceLine(char * _line) {
-    int n = strlen(_line);
-    char * s = _line;
-    char * e = &_line[n - 1];
-    // skip everthing until comma is reached
-    while (s < e) {
-        if (*s == ','){
-            break;
-        }
-        s++;
-    }
-    // skip comma, whitespace and opening double quote
-    while (s < e) {
-        if (*s == '"') {
-            s++;
-            break;
+// should we recurse into folder _name found on level _level?
+bool IocList::wantDir(const char * _name, int _level) {
+    bool recurse = true;
+    if (_level == 0) {
+        // on top level
+        // recurse into all sub-folders
+    } else if (_level == 1) {
+        // on stage level
+        // remember the path
+
+        // recurse only if we have folder called 'ioc'
+        if (strncmp(_name, "ioc", 3) != 0) {
+            recurse = false;
         }
-        s++;
+    } else if (_level == 2) {
+        // recurse into all folders
+    } else if (_level == 3) {
+        // do not recurse into any folders; last level
+        // look for instance.cmd file, see below
+        recurse = false;
+    } else {
+        assert(1 == 0);
     }
-    // get rid of closing bracket and double quote
-    while (e > s) {
-        if (isalnum(*e)) {
-            break;
+    return recurse;
+}
+
+// instance folder is [stage]/ioc/[instance]; returns the instance name
+const char * IocList::splitInstancePath(const char * _path, char * _stagePath, size_t _size) {
+    const char * instanceName = _path;
+    strncpy(_stagePath, _path, _size - 1);
+    _stagePath[_size - 1] = '\0';
+    char * slash = strrchr(_stagePath, '/');
+    if (slash) {
+        instanceName = _path + (slash - _stagePath) + 1;
+        *slash = '\0';
+        slash = strrchr(_stagePath, '/');
+        if (slash) {
+            *slash = '\0';
         }
-        e--;
     }
-    *(e + 1) = '\0';
-    return strdup(s);
+    return instanceName;
 }
 
-bool IocList::parseInstanceFile(const char * _path, const char *_name) {
-
-    char * strdup1 = strdup(_path);
-    char * strdup2 = strdup(_path);
-    char * instanceName = basename(strdup1);
-    char * stagePath = dirname(strdup2);
-    stagePath = dirname(stagePath);
-    D("GOT %s for %s in stage %s\n", _name, instanceName, stagePath);
+bool IocList::parseInstanceFile(IocRoot * _root, const char * _path, const char *_name) {
+    char path[1024];
+    snprintf(path, sizeof(path), "%s/%s", _path, _name);
 
-    size_t pathSz = strlen(_path) + strlen(_name) + 2;
-    char * path = (char *)calloc(1, pathSz);
-    sprintf(path, "%s/%s", _path, _name);
+    char stagePath[1024];
+    splitInstancePath(_path, stagePath, sizeof(stagePath));
+    D("GOT %s for %s in stage %s\n", _name, _path, stagePath);
 
-    // find the lines, extrace the values:
+    // resolve the macros the IOC will see, for example:
     //    epicsEnvSet("LOCATION", "LAB")
     //    epicsEnvSet("DEVICE_NAME", "FLIR1")
     //    epicsEnvSet("CAMERA_NAME", "FLIR-Blackfly S BFS-PGE-70S7M-20177339")
+    // we are called because the instance is new or changed, while the files
+    // it includes are checked once per scan
+    char stCmd[1024];
+    snprintf(stCmd, sizeof(stCmd), "%s/st.cmd", _path);
+    engine.invalidate(path);
+    engine.invalidate(stCmd);
+    MacroTable macros;
+    struct timespec cmdMtime = {0, 0};
+    if (! engine.resolve(stagePath, _path, macros, &cmdMtime)) {
+        E("parsing %s failed\n", path);
+        return false;
+    }
 
-    FILE *fp = fopen(path, "r");
-    if (! fp) {
-        E("fopen() failed %s\n", strerror(errno));
-        free(path);
+    // remember the mtimes so that the discovery cache can tell if this
+    // instance needs to be parsed again
+    struct stat st;
+    if (stat(_path, &st) != 0) {
         return false;
     }
+    IocWatch * watch = _root->watcher.find(_path);
+    if (watch) {
+        st.st_mtim = watch->mtime;
+    }
+    return applyInstance(_root, _path, macros, st.st_mtim, cmdMtime, st.st_dev, st.st_ino) != NULL;
+}
 
-    D("processing file %s\n", path);
-    char line[256];
-    char * loc = NULL;
-    char * dev = NULL;
-    char * deviceName = NULL;
-    while (! feof(fp)) {
-        fgets(line, 255, fp);
-        if (ferror(fp)) {
-            fclose(fp);
-            return false;
-        }
+// add or update the IOC from resolved instance macros, no file system access
+// here as the macros might come from a background scan of a slow mount
+Ioc * IocList::applyInstance(IocRoot * _root, const char * _path, MacroTable & _macros,
+    const struct timespec & _dirMtime, const struct timespec & _cmdMtime, dev_t _dev, ino_t _ino) {
+    char prefix[512];
+    const char * deviceName = instancePrefix(_macros, prefix, sizeof(prefix));
+    // macro values might not be found for some reason
+    if (deviceName == NULL) {
+        D("skipping invalid %s/instance.cmd file!\n", _path);
+        return NULL;
+    }
+
+    // the same instance folder reached through another root (bind mount,
+    // nested roots, ..) is listed once, by the root that found it first
+    Ioc * same = index.findInode(_dev, _ino);
+    if (same && same->root != _root && strcmp(same->instancePath, _path) != 0) {
+        D("%s is the same instance as %s\n", _path, same->instancePath);
+        return NULL;
+    }
 
-        if (strncmp(line, "epicsEnvSet(\"LOCATION\"", 22) == 0) {
-            loc = parseInstanceLine(line);
-            D("found LOCATION: '%s'\n", loc);
-        } else if (strncmp(line, "epicsEnvSet(\"DEVICE_NAME\"", 24) == 0) {
-            dev = parseInstanceLine(line);
-            D("found DEVICE_NAME: '%s'\n", dev);
-        } else if (strncmp(line, "epicsEnvSet(\"CAMERA_NAME\"", 24) == 0) {
-            deviceName = parseInstanceLine(line);
-            D("found CAMERA_NAME: '%s'\n", deviceName);
+    // instance.cmd might have been edited, update the existing IOC object
+    Ioc * ioc = findIoc(_path);
+    if (ioc) {
+        if (ioc->update(deviceName, prefix)) {
+            D("updated IOC %s\n", ioc->instancePath);
         }
+    } else {
+        char stagePath[1024];
+        const char * instanceName = splitInstancePath(_path, stagePath, sizeof(stagePath));
+        // create a IOC object
+        ioc = new Ioc(stagePath, _path, instanceName, deviceName, prefix);
+        ioc->root = _root;
+        ioc->dev = _dev;
+        ioc->ino = _ino;
+        addIoc(ioc);
+        D("nr IOCs %ld\n", count());
     }
-    fclose(fp);
+    ioc->root = _root;
+    ioc->dirMtime = _dirMtime;
+    ioc->cmdMtime = _cmdMtime;
+    ioc->macros.swap(_macros);
+    ioc->macrosComplete = true;
+    ioc->seen = true;
+    // found again, edited instance.cmd saved by renaming for example
+    ioc->stale = false;
+
+    return ioc;
+}
 
-    // macro values might not be found for some reason
-    if ((loc == NULL) || (dev == NULL) || (deviceName == NULL)) {
-        D("skipping invalid %s file!\n", path);
-        if (loc) free(loc);
-        if (dev) free(dev);
-        if (deviceName) free(deviceName);
-        free(path);
-        free(strdup1);
-        free(strdup2);
-        return false;
+void IocList::clear() {
+    D("have %ld IOCs\n", count());
+    for (size_t n = 0; n < roots.size(); n++) {
+        roots[n]->watcher.stop();
+    }
+    for (size_t n = 0; n < count(); n++) {
+        delete list[n];
     }
+    list.clear();
+    timeline.sources.clear();
+    timeline.valid = false;
+    index.clear();
+}
 
-    size_t prefixSz = strlen(loc) + strlen(dev) + 3;
-    char * prefix = (char *)calloc(1, prefixSz);
-    sprintf(prefix, "%s:%s:", loc, dev);
-    // create a IOC object
-    addIoc(new Ioc(stagePath, instanceName, deviceName, prefix));
-    D("nr IOCs %ld\n", count());
+// forget an IOC that is no longer found; the caller takes it out of the
+// list; a started one is only marked stale and keeps its process and logs,
+// a folder that can not be read for a moment must not kill an IOC
+bool IocList::dropIoc(Ioc * _ioc) {
+    if (_ioc->isStarted()) {
+        if (! _ioc->stale) {
+            D("IOC %s is gone, keeping it while it runs\n", _ioc->instancePath);
+            _ioc->stale = true;
+        }
+        haveStale = true;
+        return false;
+    }
+    D("removing IOC %s\n", _ioc->instancePath);
+    index.remove(_ioc);
+    timeline.remove(_ioc);
+    delete _ioc;
+    return true;
+}
 
-    free(path);
-    free(loc);
-    free(dev);
-    free(deviceName);
-    free(prefix);
-    free(strdup1);
-    free(strdup2);
+// drop the stale IOCs that were stopped since
+size_t IocList::dropStale(void) {
+    size_t removed = 0;
+    size_t kept = 0;
+    haveStale = false;
+    for (size_t n = 0; n < list.size(); n++) {
+        Ioc * ioc = list[n];
+        if (ioc->stale && dropIoc(ioc)) {
+            removed++;
+            continue;
+        }
+        list[kept++] = ioc;
+    }
+    list.resize(kept);
+    return removed;
+}
 
-    return true;
+// remove IOCs found in path _path or any of its sub-folders
+size_t IocList::removeIocs(const char * _path) {
+    size_t len = strlen(_path);
+    size_t removed = 0;
+    size_t kept = 0;
+    for (size_t n = 0; n < list.size(); n++) {
+        Ioc * ioc = list[n];
+        if (strncmp(ioc->instancePath, _path, len) == 0 &&
+            (ioc->instancePath[len] == '\0' || ioc->instancePath[len] == '/') && dropIoc(ioc)) {
+            removed++;
+            continue;
+        }
+        list[kept++] = ioc;
+    }
+    list.resize(kept);
+    return removed;
 }
 
-size_t IocList::populate(void) {
-    if (strlen(topPath) == 0) {
-        E("empty top path\n");
-        return 0;
+// same for a number of folders, in one pass
+size_t IocList::removeIocs(const std::unordered_set<std::string> & _paths) {
+    size_t removed = 0;
+    size_t kept = 0;
+    for (size_t n = 0; n < list.size(); n++) {
+        Ioc * ioc = list[n];
+        if (isBelowAny(ioc->instancePath, _paths) && dropIoc(ioc)) {
+            removed++;
+            continue;
+        }
+        list[kept++] = ioc;
     }
+    list.resize(kept);
+    return removed;
+}
 
-    D("using top path %s\n", topPath);
-    listDir(topPath, 0);
-    D("found %ld IOCs\n", count());
+// remove IOCs found in root _root, or only the ones not seen by its last scan
+size_t IocList::removeIocs(IocRoot * _root, bool _unseen) {
+    size_t removed = 0;
+    size_t kept = 0;
+    for (size_t n = 0; n < list.size(); n++) {
+        Ioc * ioc = list[n];
+        if (ioc->root == _root && (! _unseen || ! ioc->seen) && dropIoc(ioc)) {
+            removed++;
+            continue;
+        }
+        list[kept++] = ioc;
+    }
+    list.resize(kept);
+    return removed;
+}
 
-    return count();
+void LogStamps::add(uint64_t _mono) {
+    // a line read later never comes earlier
+    if (_mono < last) {
+        _mono = last;
+    }
+    if (count % LOG_CHECKPOINT_LINES == 0) {
+        struct timespec ts;
+        clock_gettime(CLOCK_REALTIME, &ts);
+        int64_t wall = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+        checkpoints.push_back(Checkpoint{_mono, wall - (int64_t)logTime(), (uint32_t)deltas.size()});
+    } else {
+        uint64_t delta = _mono - last;
+        while (delta >= 0x80) {
+            deltas.push_back((delta & 0x7f) | 0x80);
+            delta >>= 7;
+        }
+        deltas.push_back(delta);
+    }
+    last = _mono;
+    count++;
 }
 
-void IocList::clear() {
-    D("have %ld IOCs\n", count());
-    for (size_t n = 0; n < count(); n++) {
-        delete list[n];
+uint64_t LogStamps::mono(size_t _line) {
+    if (_line == cursorLine) {
+        return cursorMono;
     }
-    list.clear();
+    if (cursorLine == (size_t)-1 || _line < cursorLine || _line / LOG_CHECKPOINT_LINES != cursorLine / LOG_CHECKPOINT_LINES) {
+        const Checkpoint & checkpoint = checkpoints[_line / LOG_CHECKPOINT_LINES];
+        cursorLine = _line & ~(size_t)(LOG_CHECKPOINT_LINES - 1);
+        cursorOffset = checkpoint.offset;
+        cursorMono = checkpoint.mono;
+    }
+    while (cursorLine < _line) {
+        uint64_t delta = 0;
+        int shift = 0;
+        unsigned char byte;
+        do {
+            byte = deltas[cursorOffset++];
+            delta |= (uint64_t)(byte & 0x7f) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+        cursorMono += delta;
+        cursorLine++;
+    }
+    return cursorMono;
 }
 
+// first line read at or after _mono, count if none
+size_t LogStamps::find(uint64_t _mono) {
+    auto it = std::lower_bound(checkpoints.begin(), checkpoints.end(), _mono, [](const Checkpoint & a, uint64_t b) {
+        return a.mono < b;
+    });
+    size_t line = 0;
+    if (it != checkpoints.begin()) {
+        line = (it - checkpoints.begin() - 1) * LOG_CHECKPOINT_LINES;
+    }
+    while (line < count && mono(line) < _mono) {
+        line++;
+    }
+    return line;
+}
 
+// scroll to the first line read at or after _time, HH:MM[:SS.mmm] on the
+// day of the last line
+void ChildData::jumpTo(const char * _time) {
+    int hour = 0, minute = 0;
+    double second = 0.0;
+    if (stamps.count == 0 || sscanf(_time, "%d:%d:%lf", &hour, &minute, &second) < 2) {
+        return;
+    }
+    size_t last = stamps.count - 1;
+    int64_t offset = stamps.wallOffset(last);
+    time_t wall = (stamps.mono(last) + offset) / 1000000;
+    struct tm tm;
+    localtime_r(&wall, &tm);
+    tm.tm_hour = hour;
+    tm.tm_min = minute;
+    tm.tm_sec = 0;
+    tm.tm_isdst = -1;
+    int64_t mono = (int64_t)mktime(&tm) * 1000000 + (int64_t)(second * 1e6) - offset;
+    jumpLine = std::min(stamps.find(std::max(mono, (int64_t)0)), last);
+    autoScroll = false;
+}
 
 void ChildData::extractLines(void) {
     char * s = buffer;
     char * e = buffer;
     char * eob = &buffer[size];
     char c;
+    // all the lines of a read came in at the same time
+    uint64_t now = logTime();
     while (e < eob) {
         if (*e == '\n') {
             e++;
             c = *e;
             *e = '\0';
-            addLine(s);
+            addLine(s, now);
             *e = c;
             s = e;
         }
@@ -264,31 +423,350 @@ void ChildData::extractLines(void) {
     }
 }
 
-int ChildData::recvResponse(void) {
-    struct pollfd fds;
-    nfds_t nfds = 1;
-    // timeout in milliseconds
-    int timeout = 1;
+// the 16 ANSI colors, a bit lighter than usual for the dark background
+static const ImU32 ansiPalette[16] = {
+    IM_COL32(0x60, 0x60, 0x60, 255), IM_COL32(0xe0, 0x50, 0x50, 255),
+    IM_COL32(0x50, 0xc0, 0x50, 255), IM_COL32(0xd0, 0xc0, 0x40, 255),
+    IM_COL32(0x50, 0x80, 0xf0, 255), IM_COL32(0xc0, 0x60, 0xc0, 255),
+    IM_COL32(0x40, 0xc0, 0xc0, 255), IM_COL32(0xd0, 0xd0, 0xd0, 255),
+    IM_COL32(0x90, 0x90, 0x90, 255), IM_COL32(0xff, 0x70, 0x70, 255),
+    IM_COL32(0x70, 0xff, 0x70, 255), IM_COL32(0xff, 0xff, 0x60, 255),
+    IM_COL32(0x80, 0xa0, 0xff, 255), IM_COL32(0xff, 0x80, 0xff, 255),
+    IM_COL32(0x70, 0xff, 0xff, 255), IM_COL32(0xff, 0xff, 0xff, 255),
+};
+
+// xterm 256 colors: the 16 above, a 6x6x6 cube and 24 grays
+static ImU32 ansiColor256(int _n) {
+    if (_n < 16) {
+        return ansiPalette[_n & 15];
+    }
+    if (_n < 232) {
+        static const int levels[6] = { 0, 95, 135, 175, 215, 255 };
+        _n -= 16;
+        return IM_COL32(levels[_n / 36], levels[_n / 6 % 6], levels[_n % 6], 255);
+    }
+    int gray = 8 + (std::min(_n, 255) - 232) * 10;
+    return IM_COL32(gray, gray, gray, 255);
+}
+
+// SGR parameters; only the foreground color and bold matter here
+void ChildData::applySgr(const int * _params, int _count) {
+    for (int n = 0; n < _count; n++) {
+        int param = _params[n];
+        if (param == 0) {
+            colorIndex = -1;
+            colorBold = false;
+        } else if (param == 1) {
+            colorBold = true;
+        } else if (param == 22) {
+            colorBold = false;
+        } else if (param >= 30 && param <= 37) {
+            colorIndex = param - 30;
+        } else if (param >= 90 && param <= 97) {
+            colorIndex = param - 90 + 8;
+        } else if (param == 39) {
+            colorIndex = -1;
+        } else if ((param == 38 || param == 48) && n + 1 < _count) {
+            // 5;n or 2;r;g;b, the background is skipped
+            int kind = _params[n + 1];
+            if (kind == 5 && n + 2 < _count) {
+                if (param == 38) {
+                    colorIndex = ANSI_COLOR_RGB;
+                    color = ansiColor256(_params[n + 2]);
+                }
+                n += 2;
+            } else if (kind == 2 && n + 4 < _count) {
+                if (param == 38) {
+                    colorIndex = ANSI_COLOR_RGB;
+                    color = IM_COL32(_params[n + 2] & 0xff, _params[n + 3] & 0xff, _params[n + 4] & 0xff, 255);
+                }
+                n += 4;
+            } else {
+                n++;
+            }
+        }
+    }
+    if (colorIndex < 0) {
+        color = 0;
+    } else if (colorIndex < 8) {
+        // bold comes out as the bright color
+        color = ansiPalette[colorIndex + (colorBold ? 8 : 0)];
+    } else if (colorIndex < 16) {
+        color = ansiPalette[colorIndex];
+    }
+}
+
+// takes the escape sequences out of the line about to be added and notes
+// where the color changes; returns the text to keep
+const char * ChildData::parseColors(const char * _line) {
+    colorLine.clear();
+    uint32_t line = lineOffsets.Size;
+    size_t spanStart = 0;
+    ImU32 spanColor = color;
+    const char * p = _line;
+    for (;;) {
+        const char * escape = strchr(p, '\x1b');
+        if (! escape) {
+            colorLine.append(p);
+            break;
+        }
+        colorLine.append(p, escape - p);
+        p = escape + 1;
+        if (*p == '[') {
+            // CSI: parameters, intermediate bytes and a final byte
+            int params[16];
+            int count = 0;
+            int value = 0;
+            for (p++; *p >= 0x30 && *p <= 0x3f; p++) {
+                if (*p >= '0' && *p <= '9') {
+                    value = value * 10 + (*p - '0');
+                } else if (*p == ';' && count < 15) {
+                    params[count++] = value;
+                    value = 0;
+                }
+            }
+            params[count++] = value;
+            while (*p >= 0x20 && *p <= 0x2f) {
+                p++;
+            }
+            if (*p == 'm') {
+                applySgr(params, count);
+            }
+        } else if (*p == ']') {
+            // OSC, a window title and such, up to BEL or ST
+            while (*p && *p != '\a' && ! (*p == '\x1b' && p[1] == '\\')) {
+                p++;
+            }
+            if (*p == '\x1b') {
+                p++;
+            }
+        }
+        if (*p) {
+            p++;
+        }
+        if (color != spanColor) {
+            if (spanColor && colorLine.size() > spanStart) {
+                spans.push_back(ColorSpan{line, (uint16_t)spanStart, (uint16_t)(colorLine.size() - spanStart), spanColor});
+            }
+            spanStart = colorLine.size();
+            spanColor = color;
+        }
+    }
+    size_t end = colorLine.size();
+    if (end && colorLine[end - 1] == '\n') {
+        end--;
+    }
+    if (spanColor && end > spanStart) {
+        spans.push_back(ColorSpan{line, (uint16_t)spanStart, (uint16_t)(end - spanStart), spanColor});
+    }
+    return colorLine.c_str();
+}
+
+// the line just added, or repeated, counted by its severity
+void ChildData::classify(const char * _line, uint64_t _mono) {
+    int severity = matcher->highest(_line, SEVERITY_ERROR);
+    uint32_t line = lineOffsets.Size - 1;
+    if (severity == SEVERITY_ERROR) {
+        if (errorLines.empty() || errorLines.back() != line) {
+            errorLines.push_back(line);
+        }
+        errors++;
+        // the copy outlives a cleared log
+        size_t len = strcspn(_line, "\n");
+        snprintf(lastError, sizeof(lastError), "%.*s", (int)len, _line);
+        lastErrorMono = _mono;
+        lastErrorWall = _mono + stamps.wallOffset(stamps.count - 1);
+    } else if (severity == SEVERITY_WARNING) {
+        if (warningLines.empty() || warningLines.back() != line) {
+            warningLines.push_back(line);
+        }
+        warnings++;
+    }
+}
+
+// a marker line came in, see LATENCY_MARKER
+void ChildData::addProbe(const char * _stamp) {
+    unsigned long long stamp = strtoull(_stamp, NULL, 10);
+    // the IOC shell may echo the probe command before it runs it, the
+    // first line with the marker counts
+    if (stamp == 0 || stamp <= lastMarker) {
+        return;
+    }
+    lastMarker = stamp;
+    LatencyProbe probe;
+    probe.line = lineOffsets.Size - 1;
+    probe.written = stamp * 1e-9;
+    probe.ingested = launcherTime();
+    probes.push_back(probe);
+}
+
+// the colored parts one after another, as found by parseColors()
+void ChildData::drawText(int _line) {
+    const char * end;
+    const char * start = lineText(_line, &end);
+    // errors and warnings stand out, unless the IOC colored the line itself
+    ImU32 tint = 0;
+    if (errorLines.size() && errorLines.back() >= (uint32_t)_line &&
+        std::binary_search(errorLines.begin(), errorLines.end(), (uint32_t)_line)) {
+        tint = IM_COL32(0xff, 0x60, 0x60, 255);
+    } else if (warningLines.size() && warningLines.back() >= (uint32_t)_line &&
+        std::binary_search(warningLines.begin(), warningLines.end(), (uint32_t)_line)) {
+        tint = IM_COL32(0xff, 0xc0, 0x40, 255);
+    }
+    if (tint) {
+        ImGui::PushStyleColor(ImGuiCol_Text, tint);
+    }
+    // picked out by a trigger
+    if (highlightLines.size() && highlightLines.back() >= (uint32_t)_line &&
+        std::binary_search(highlightLines.begin(), highlightLines.end(), (uint32_t)_line)) {
+        ImVec2 pos = ImGui::GetCursorScreenPos();
+        ImVec2 size(ImGui::GetContentRegionAvail().x, ImGui::GetTextLineHeight());
+        ImGui::GetWindowDrawList()->AddRectFilled(pos, ImVec2(pos.x + size.x, pos.y + size.y), IM_COL32(0x60, 0x40, 0xa0, 160));
+    }
+    if (filterNeedle.size()) {
+        drawFilterMatches(start, end);
+    }
+    // found by the search box, the one scrolled to more so
+    if (matches.size() && matches.back() >= (uint32_t)_line &&
+        std::binary_search(matches.begin(), matches.end(), (uint32_t)_line)) {
+        bool current = currentMatch >= 0 && matches[currentMatch] == (uint32_t)_line;
+        ImVec2 pos = ImGui::GetCursorScreenPos();
+        ImVec2 size(ImGui::GetContentRegionAvail().x, ImGui::GetTextLineHeight());
+        ImGui::GetWindowDrawList()->AddRectFilled(pos, ImVec2(pos.x + size.x, pos.y + size.y),
+            current ? IM_COL32(0x30, 0x70, 0xc0, 200) : IM_COL32(0x30, 0x50, 0x70, 120));
+    }
+    auto span = spans.end();
+    if (spans.size() && spans.back().line >= (uint32_t)_line) {
+        span = std::lower_bound(spans.begin(), spans.end(), (uint32_t)_line, [](const ColorSpan & a, uint32_t b) {
+            return a.line < b;
+        });
+    }
+    const char * p = start;
+    for (; span != spans.end() && span->line == (uint32_t)_line; ++span) {
+        const char * from = std::min(start + span->offset, end);
+        const char * to = std::min(from + span->length, end);
+        if (from > p) {
+            ImGui::TextUnformatted(p, from);
+            ImGui::SameLine(0.0f, 0.0f);
+        }
+        ImGui::PushStyleColor(ImGuiCol_Text, span->color);
+        ImGui::TextUnformatted(from, to);
+        ImGui::PopStyleColor();
+        ImGui::SameLine(0.0f, 0.0f);
+        p = to;
+    }
+    ImGui::TextUnformatted(p, end);
+    if (tint) {
+        ImGui::PopStyleColor();
+    }
+    // said again, the repeats are shown on a click
+    LogRepeat * repeat = findRepeat(_line);
+    if (repeat) {
+        ImGui::SameLine();
+        ImGui::TextDisabled("(\xc3\x97%u)", repeat->count + 1);
+        if (ImGui::IsItemClicked()) {
+            expandLine = _line;
+            ImGui::OpenPopup(name);
+        }
+    }
+}
+
+// marker lines are timed the first time they are drawn in view
+void ChildData::drawLine(int _line) {
+    if (showStamps) {
+        int64_t wall = stamps.mono(_line) + stamps.wallOffset(_line);
+        time_t sec = wall / 1000000;
+        struct tm tm;
+        localtime_r(&sec, &tm);
+        ImGui::TextDisabled("%02d:%02d:%02d.%03d", tm.tm_hour, tm.tm_min, tm.tm_sec, (int)(wall % 1000000 / 1000));
+        ImGui::SameLine();
+    }
+    drawText(_line);
+    for (size_t n = 0; n < probes.size(); n++) {
+        if (probes[n].line == _line && ImGui::IsItemVisible()) {
+            double now = launcherTime();
+            measured.push_back(std::make_pair((probes[n].ingested - probes[n].written) * 1e3, (now - probes[n].written) * 1e3));
+            probes.erase(probes.begin() + n);
+            break;
+        }
+    }
+}
 
-    fds.fd = fd;
-    fds.events = POLLIN;
-    fds.revents = 0;
+// only the lines in view are drawn; with a filter only the lines it found
+void ChildData::drawLines(void) {
+    bool filtering = filterNeedle.size() || filterCluster >= 0;
+    if (jumpLine >= 0) {
+        int row = jumpLine;
+        if (filtering) {
+            row = std::lower_bound(filtered.begin(), filtered.end(), (uint32_t)jumpLine) - filtered.begin();
+        }
+        ImGui::SetScrollY(row * ImGui::GetTextLineHeightWithSpacing());
+        jumpLine = -1;
+    }
+    ImGuiListClipper clipper;
+    clipper.Begin(filtering ? filtered.size() : lineOffsets.Size);
+    while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+            drawLine(filtering ? filtered[row] : row);
+        }
+    }
+    clipper.End();
+    drawRepeats();
+}
 
-    int n = poll(&fds, nfds, timeout);
-    if (n == -1) {
-        E("poll() %s failed %s\n", name, strerror(errno));
-    } else if (n) {
-        D("%s revents %d ..\n", name, fds.revents);
-        if (fds.revents & POLLHUP) {
+void ChildData::drawControls(void) {
+    ImGui::Checkbox("auto scroll", &autoScroll);
+    ImGui::SameLine();
+    if (ImGui::Button("clear")) {
+        clear();
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("time", &showStamps);
+    ImGui::SameLine();
+    ImGui::Checkbox("collapse repeats", &collapseRepeats);
+    ImGui::SameLine();
+    bool packed = compact;
+    if (ImGui::Checkbox("compact", &packed)) {
+        setCompact(packed);
+    }
+    if (compact) {
+        ImGui::SameLine();
+        drawTemplates();
+    }
+    ImGui::SameLine();
+    ImGui::Checkbox("timeline", &inTimeline);
+    ImGui::SameLine();
+    ImGui::PushItemWidth(100);
+    if (ImGui::InputTextWithHint("##jump", "jump to time", jumpText, IM_ARRAYSIZE(jumpText), ImGuiInputTextFlags_EnterReturnsTrue)) {
+        jumpTo(jumpText);
+    }
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    ImGui::Text("%zu lines, %zu bytes, %zu bytes of times", lines, textBytes(),
+        stamps.deltas.size() + stamps.checkpoints.size() * sizeof(LogStamps::Checkpoint));
+    drawSearch();
+    ImGui::SameLine();
+    drawFilter();
+}
+
+// read what the poll in Ioc::recvResponse() found
+int ChildData::recvResponse(short _revents) {
+    int n = 0;
+    if (_revents) {
+        D("%s revents %d ..\n", name, _revents);
+        if (_revents & POLLHUP) {
             // remote end has closed the connection (exit issued?)
             errno = EPIPE;
             E("**** IOC not responding ***");
-            addLine("**** IOC not responding ***");
+            addLine("**** IOC not responding ***\n");
             // return error
             n = -1;
-        } else if (fds.revents & POLLIN) {
+        } else if (_revents & POLLIN) {
             D("%s size %zu ..\n", name, size);
-            n = read(fd, buffer + size, 4095 - size);
+            {
+                PROFILE_ZONE_ARG("read", label);
+                n = read(fd, buffer + size, 4095 - size);
+            }
             size += n;
             buffer[size] = '\0';
             D("%s nRecv %d size %zu, RECV: \n'%s'\n",
@@ -297,10 +775,8 @@ int ChildData::recvResponse(void) {
             // return number of bytes available in buffer
             n = size;
         } else {
-            E("%s UNHANDLED revents %d ..\n", name, fds.revents);
+            E("%s UNHANDLED revents %d ..\n", name, _revents);
         }
-    } else {
-        // D("timeout occured\n");
     }
 
     return n;
@@ -376,9 +852,19 @@ int Ioc::start() {
     childStdin = pipe_stdin[1];
     childStdout.fd = pipe_stdout[0];
     childStdout.clear();
+    snprintf(childStdout.label, sizeof(childStdout.label), "%s stdout", deviceName);
     childStderr.fd = pipe_stderr[0];
     childStderr.clear();
+    snprintf(childStderr.label, sizeof(childStderr.label), "%s stderr", deviceName);
+    sequence = 0;
+    childStdout.resetCounts();
+    childStderr.resetCounts();
     started = true;
+    PROFILE_INSTANT("spawn", deviceName);
+    if (index) {
+        // views sorted by state
+        index->generation++;
+    }
 
     return 0;
 }
@@ -418,6 +904,10 @@ int Ioc::stop() {
     }
 
     started = false;
+    PROFILE_INSTANT("exit", deviceName);
+    if (index) {
+        index->generation++;
+    }
     pid = 0;
     close(childStdin);
     childStdin = -1;
@@ -430,6 +920,46 @@ int Ioc::stop() {
     return 0;
 }
 
+// instance.cmd was edited, refresh the values parsed from it
+bool Ioc::update(const char * _deviceName, const char * _prefix) {
+    if (strcmp(deviceName, _deviceName) == 0 && strcmp(prefix, _prefix) == 0) {
+        return false;
+    }
+    if (index) {
+        index->remove(this);
+    }
+    free(deviceName);
+    deviceName = strdup(_deviceName);
+    free(prefix);
+    prefix = strdup(_prefix);
+    if (index) {
+        index->insert(this);
+    }
+    return true;
+}
+
+// resolve the macros again; files included by instance.cmd might have
+// changed, or the IOC was loaded from the discovery cache
+bool Ioc::resolve(void) {
+    // do not retry every frame
+    macrosComplete = true;
+    if (! engine) {
+        return false;
+    }
+    MacroTable resolved;
+    if (! engine->resolve(stagePath, instancePath, resolved, NULL)) {
+        E("resolving macros of %s failed\n", instancePath);
+        return false;
+    }
+    char newPrefix[512];
+    const char * newDeviceName = instancePrefix(resolved, newPrefix, sizeof(newPrefix));
+    if (newDeviceName && update(newDeviceName, newPrefix)) {
+        D("updated IOC %s\n", instancePath);
+    }
+    macros.swap(resolved);
+    return newDeviceName != NULL;
+}
+
 int Ioc::sendCommand(const char * _command) {
     size_t cmdSz = strlen(_command);
     D("new command for child [%zu]] '%s'\n", cmdSz, _command);
@@ -440,12 +970,76 @@ int Ioc::sendCommand(const char * _command) {
     return 0;
 }
 
-int Ioc::recvResponse(void) {
+// ask the IOC shell to echo a marker line back; iocsh and tools/fakeioc
+// both know echo
+void Ioc::sendProbe(void) {
+    if (! started) {
+        return;
+    }
+    char command[64];
+    snprintf(command, sizeof(command), "echo %s%llu", LATENCY_MARKER, (unsigned long long)profilerNow());
+    sendCommand(command);
+}
+
+// collect the marker lines drawn in the last frame into the IOC and the
+// main loop mode statistics, send the next probe when due
+void Ioc::updateProbes(double _now, LatencyStats & _mode) {
+    ChildData * streams[] = { &childStdout, &childStderr };
+    for (size_t n = 0; n < IM_ARRAYSIZE(streams); n++) {
+        ChildData * stream = streams[n];
+        for (size_t m = 0; m < stream->measured.size(); m++) {
+            latency.add(stream->measured[m].first, stream->measured[m].second);
+            _mode.add(stream->measured[m].first, stream->measured[m].second);
+        }
+        stream->measured.clear();
+        // never scrolled into view, or the window is not open
+        while (stream->probes.size() && _now - stream->probes[0].ingested > LATENCY_TIMEOUT) {
+            stream->probes.erase(stream->probes.begin());
+            latency.missed++;
+            _mode.missed++;
+        }
+    }
+    if (probing && started && _now >= nextProbe) {
+        sendProbe();
+        nextProbe = _now + 1.0;
+    }
+}
 
-    int ret = 0;
+// one poll for both pipes; stdout is read first, an error usually comes
+// after the stdout line that led to it
+int Ioc::recvResponse(void) {
+    struct pollfd fds[2];
+    fds[0].fd = childStdout.fd;
+    fds[0].events = POLLIN;
+    fds[0].revents = 0;
+    fds[1].fd = childStderr.fd;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+
+    int ret;
+    {
+        PROFILE_ZONE_ARG("poll", deviceName);
+        // timeout in milliseconds; the main loop sleeps elsewhere
+        ret = poll(fds, 2, 0);
+    }
+    if (ret == -1) {
+        E("poll() %s failed %s\n", deviceName, strerror(errno));
+        return ret;
+    }
+    if (ret == 0) {
+        return 0;
+    }
 
-    ret |= childStderr.recvResponse();
-    ret |= childStdout.recvResponse();
+    bool clean = ! errors();
+    bool quiet = ! warnings();
+    ret = 0;
+    ret |= childStdout.recvResponse(fds[0].revents);
+    ret |= childStderr.recvResponse(fds[1].revents);
+    if (index && ((clean && errors()) || (quiet && warnings()))) {
+        // views sorted or filtered by errors, only on the first one; the
+        // order of IOCs that already had some may go stale
+        index->generation++;
+    }
     if (ret == -1) {
         E("poll()/read() failed %s\n", strerror(errno));
     }
@@ -454,6 +1048,7 @@ int Ioc::recvResponse(void) {
 }
 
 void Ioc::draw(void) {
+    PROFILE_ZONE("Ioc::draw");
     // show IOC status
     if (started) {
         ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(0.4f, 1.0f, 0.4f, 1.0f));
@@ -475,26 +1070,38 @@ void Ioc::draw(void) {
     }
     ImGui::SameLine();
     ImGui::Text("PID %d", pid);
+    ImGui::SameLine();
+    ImGui::Checkbox("one pane", &combined);
     ImGui::Separator();
 
-    ImGui::PushID("StdOut");
-    ImGui::Checkbox("auto scroll", &childStdout.autoScroll);
-    ImGui::SameLine();
-    if (ImGui::Button("clear")) {
-        childStdout.clear();
+    // show the instance.cmd macros
+    if (ImGui::CollapsingHeader("Macros")) {
+        if (! macrosComplete) {
+            resolve();
+        }
+        for (size_t n = 0; n < macros.count(); n++) {
+            ImGui::Text("%s = %s", macros.name(n), macros.value(n));
+        }
+        ImGui::Separator();
     }
-    ImGui::SameLine();
-    ImGui::Text("%zu lines, %d bytes", childStdout.lines, childStdout.linesBuffer.size());
+
+    // time from the IOC writing a line to it being on the screen
+    if (ImGui::CollapsingHeader("Output latency")) {
+        if (ImGui::Button("Probe")) {
+            sendProbe();
+        }
+        ImGui::SameLine();
+        ImGui::Checkbox("every second", &probing);
+        latency.draw();
+        ImGui::Separator();
+    }
+
+    ImGui::PushID("StdOut");
+    childStdout.drawControls();
     ImGui::PopID();
 
     ImGui::PushID("StdErr");
-    ImGui::Checkbox("auto scroll", &childStderr.autoScroll);
-    ImGui::SameLine();
-    if (ImGui::Button("clear")) {
-        childStderr.clear();
-    }
-    ImGui::SameLine();
-    ImGui::Text("%zu lines, %d bytes", childStderr.lines, childStderr.linesBuffer.size());
+    childStderr.drawControls();
     ImGui::PopID();
 
     ImGui::Separator();
@@ -518,19 +1125,24 @@ void Ioc::draw(void) {
         ImGui::SetKeyboardFocusHere(-1);
     }
 
-    // get IOC shell output/error bytes
-    int ret = recvResponse();
-    if (ret < 0) {
-        // child has closed the pipe.. stop the communication
-        if (errno == EPIPE) {
-            stop();
+    if (combined) {
+        ImGui::Separator();
+        ImGui::BeginChild("AllLog");
+        drawCombined();
+        bool bottom = childStdout.scrollToBottom || childStderr.scrollToBottom;
+        if (bottom || (childStdout.autoScroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY())) {
+            ImGui::SetScrollHereY(1.0f);
         }
+        childStdout.scrollToBottom = false;
+        childStderr.scrollToBottom = false;
+        ImGui::EndChild();
+        return;
     }
 
     // show the IOC shell output response
     ImGui::Separator();
     ImGui::BeginChild("OutLog", ImVec2(0, -103));
-    ImGui::TextUnformatted(childStdout.linesBuffer.begin(), childStdout.linesBuffer.end());
+    childStdout.drawLines();
     if (childStdout.scrollToBottom || (childStdout.autoScroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY())){
         ImGui::SetScrollHereY(1.0f);
     }
@@ -541,7 +1153,7 @@ void Ioc::draw(void) {
     ImGui::Separator();
     ImGui::BeginChild("ErrLog", ImVec2(0, 100));
     ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.4f, 0.4f, 1.0f));
-    ImGui::TextUnformatted(childStderr.linesBuffer.begin(), childStderr.linesBuffer.end());
+    childStderr.drawLines();
     if (childStderr.scrollToBottom || (childStderr.autoScroll && ImGui::GetScrollY() >= ImGui::GetScrollMaxY())){
         ImGui::SetScrollHereY(1.0f);
     }
@@ -550,6 +1162,71 @@ void Ioc::draw(void) {
     ImGui::EndChild();
 }
 
+// stdout and stderr lines in the order they came in, merged by their
+// sequence numbers as they are drawn; only the lines in view are drawn
+void Ioc::drawCombined(void) {
+    ChildData & out = childStdout;
+    ChildData & err = childStderr;
+    float lineHeight = ImGui::GetTextLineHeightWithSpacing();
+    if (out.jumpLine >= 0) {
+        ImGui::SetScrollY((out.jumpLine + err.before(out.sequence[out.jumpLine])) * lineHeight);
+        out.jumpLine = -1;
+    }
+    if (err.jumpLine >= 0) {
+        ImGui::SetScrollY((err.jumpLine + out.before(err.sequence[err.jumpLine])) * lineHeight);
+        err.jumpLine = -1;
+    }
+    ImGuiListClipper clipper;
+    clipper.Begin(out.lineOffsets.Size + err.lineOffsets.Size);
+    while (clipper.Step()) {
+        // sequence number of the first row: the last one with no more
+        // rows before it than the row number
+        size_t row = clipper.DisplayStart;
+        uint32_t lo = 0, hi = sequence;
+        while (lo < hi) {
+            uint32_t mid = lo + (hi - lo + 1) / 2;
+            if (out.before(mid) + err.before(mid) <= row) {
+                lo = mid;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        size_t o = out.before(lo);
+        size_t e = err.before(lo);
+        for (; row < (size_t)clipper.DisplayEnd; row++) {
+            if (o < out.sequence.size() && (e >= err.sequence.size() || out.sequence[o] < err.sequence[e])) {
+                out.drawLine(o++);
+            } else if (e < err.sequence.size()) {
+                ImGui::PushStyleColor(ImGuiCol_Text, ImVec4(1.0f, 0.4f, 0.4f, 1.0f));
+                err.drawLine(e++);
+                ImGui::PopStyleColor();
+            }
+        }
+    }
+    clipper.End();
+    out.drawRepeats();
+    err.drawRepeats();
+}
+
+// get IOC shell output/error bytes of all the running IOCs, whether their
+// window is open or not, so that the children never block on a full pipe
+void IocList::recvResponses(void) {
+    PROFILE_ZONE("recvResponses");
+    for (size_t n = 0; n < list.size(); n++) {
+        Ioc * ioc = list[n];
+        if (! ioc->started) {
+            continue;
+        }
+        int ret = ioc->recvResponse();
+        // child has closed the pipe.. stop the communication; before the
+        // triggers run, so that a restart by one of them stays in place
+        if (ret < 0 && errno == EPIPE) {
+            ioc->stop();
+        }
+        fireTriggers(ioc);
+    }
+}
+
 void Ioc::show(bool * _open) {
     ImGui::SetNextWindowSize(ImVec2(520, 600), ImGuiCond_FirstUseEver);
     if (! ImGui::Begin(deviceName, _open)) {
@@ -562,66 +1239,513 @@ void Ioc::show(bool * _open) {
     ImGui::End();
 }
 
+static float latencyPercentile(std::vector<float> _values, int _pct) {
+    std::sort(_values.begin(), _values.end());
+    return _values[(_values.size() - 1) * _pct / 100];
+}
+
+void LatencyStats::draw(void) {
+    if (ingest.empty()) {
+        ImGui::TextDisabled("no marker lines shown yet, %zu missed", missed);
+        return;
+    }
+    ImGui::Text("%zu marker lines, %zu never shown", count, missed);
+    ImGui::Text("read    p50 %7.2f  p90 %7.2f  p99 %7.2f ms", latencyPercentile(ingest, 50),
+        latencyPercentile(ingest, 90), latencyPercentile(ingest, 99));
+    ImGui::Text("visible p50 %7.2f  p90 %7.2f  p99 %7.2f ms", latencyPercentile(visible, 50),
+        latencyPercentile(visible, 90), latencyPercentile(visible, 99));
+    // log2 bins from 1/16 ms up, buffer swap and vsync come on top
+    float bins[16] = { 0 };
+    for (size_t n = 0; n < visible.size(); n++) {
+        int bin = (visible[n] > 0.0f) ? (int)floorf(log2f(visible[n] * 16.0f)) : 0;
+        bins[std::max(0, std::min(bin, 15))]++;
+    }
+    ImGui::PlotHistogram("##latency", bins, IM_ARRAYSIZE(bins), 0, "1/16 ms .. 2 s, x2 per bar", 0.0f, FLT_MAX, ImVec2(0, 60));
+}
+
+// marker lines are grouped by how the main loop runs
+void IocList::updateProbes(void) {
+    char mode[64];
+    if (loop.maxFps) {
+        snprintf(mode, sizeof(mode), "%s, %d FPS max", loop.idle ? "sleep when idle" : "no sleep", loop.maxFps);
+    } else {
+        snprintf(mode, sizeof(mode), "%s, no FPS limit", loop.idle ? "sleep when idle" : "no sleep");
+    }
+    LatencyStats & stats = latencyModes[mode];
+    double now = launcherTime();
+    for (size_t n = 0; n < list.size(); n++) {
+        Ioc * ioc = list[n];
+        if (ioc->started || ioc->childStdout.probes.size() || ioc->childStderr.probes.size()) {
+            ioc->updateProbes(now, stats);
+        }
+    }
+}
+
 IocList *  launcherInitialize(void) {
     IocList * iocs = new IocList();
     IM_ASSERT(iocs != NULL);
+    iocs->loadRoots();
+    iocs->loadSeverity();
+    iocs->loadTriggers();
+    // show what we found last time right away, validate it in the background
+    iocs->loadCache();
+    for (size_t n = 0; n < iocs->roots.size(); n++) {
+        iocs->startScan(iocs->roots[n]);
+    }
     D("starting loop!\n");
     return iocs;
 }
 
+void IocTable::sort(std::vector<Ioc *> & _list) {
+    order.resize(_list.size());
+    for (size_t n = 0; n < order.size(); n++) {
+        order[n] = n;
+    }
+    int column = sortColumn;
+    std::stable_sort(order.begin(), order.end(), [&_list, column](uint32_t a, uint32_t b) {
+        Ioc * iocA = _list[a];
+        Ioc * iocB = _list[b];
+        int cmp = 0;
+        switch (column) {
+        case IOC_COLUMN_NAME:
+            cmp = strcmp(iocA->deviceName, iocB->deviceName);
+            break;
+        case IOC_COLUMN_PREFIX:
+            cmp = strcmp(iocA->prefix, iocB->prefix);
+            break;
+        case IOC_COLUMN_STARTED:
+            cmp = (int)iocB->started - (int)iocA->started;
+            break;
+        case IOC_COLUMN_ERRORS:
+            // most first
+            cmp = (iocA->errors() != iocB->errors()) ? (iocA->errors() > iocB->errors() ? -1 : 1) :
+                (iocA->warnings() != iocB->warnings()) ? (iocA->warnings() > iocB->warnings() ? -1 : 1) : 0;
+            break;
+        default:
+            break;
+        }
+        return cmp ? cmp < 0 : a < b;
+    });
+    if (sortDescending) {
+        std::reverse(order.begin(), order.end());
+    }
+    sorted = true;
+}
+
+// can the rows that passed query _old be filtered further for query _new,
+// instead of going through all the IOCs again? only when a single search
+// term grows; more terms (a,b) or exclusions (-a) widen the result
+static bool refines(const char * _old, const char * _new) {
+    size_t len = strlen(_old);
+    const char * term = _new;
+    while (*term == ' ') {
+        term++;
+    }
+    return len && strncmp(_old, _new, len) == 0 && ! strchr(_new, ',') && *term != '-';
+}
+
+// ASCII only, like ImGuiTextFilter
+static void appendLower(std::vector<char> & _text, const char * _str) {
+    size_t len = strlen(_str);
+    size_t at = _text.size();
+    _text.resize(at + len);
+    for (size_t n = 0; n < len; n++) {
+        char c = _str[n];
+        _text[at + n] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+    }
+}
+
+// the text each IOC is matched against, made once per IOC change instead of
+// for every IOC on every key press
+void IocTable::buildTexts(std::vector<Ioc *> & _list) {
+    texts.clear();
+    texts.reserve(_list.size() * 64);
+    textStart.resize(_list.size());
+    for (size_t n = 0; n < _list.size(); n++) {
+        Ioc * ioc = _list[n];
+        textStart[n] = texts.size();
+        appendLower(texts, ioc->deviceName);
+        texts.push_back(' ');
+        appendLower(texts, ioc->prefix);
+        texts.push_back(' ');
+        appendLower(texts, ioc->stagePath);
+        texts.push_back(' ');
+        appendLower(texts, ioc->started ? "started" : "stopped");
+        if (ioc->errors()) {
+            appendLower(texts, " errors");
+        }
+        if (ioc->warnings()) {
+            appendLower(texts, " warnings");
+        }
+        texts.push_back('\0');
+    }
+}
+
+// keep the rows passing the filter; from the rows that passed the previous
+// query if _refine, else from all the IOCs
+// same rules as ImGuiTextFilter::PassFilter(), on the lower case texts
+void IocTable::filterRows(bool _refine) {
+    strcpy(rowsQuery, filter.InputBuf);
+    if (! filter.IsActive()) {
+        rows = order;
+        return;
+    }
+
+    // terms in order, the first one found decides; "-term" excludes
+    std::vector<std::string> terms;
+    std::vector<bool> subtract;
+    bool grep = false;
+    for (int n = 0; n < filter.Filters.Size; n++) {
+        const ImGuiTextFilter::ImGuiTextRange & range = filter.Filters[n];
+        if (range.empty()) {
+            continue;
+        }
+        std::string term;
+        subtract.push_back(range.b[0] == '-');
+        grep = grep || ! subtract.back();
+        term.assign(range.b + (subtract.back() ? 1 : 0), range.e);
+        std::vector<char> lower;
+        appendLower(lower, term.c_str());
+        terms.push_back(std::string(lower.begin(), lower.end()));
+    }
+
+    const std::vector<uint32_t> & from = _refine ? rows : order;
+    std::vector<uint32_t> passed;
+    passed.reserve(from.size());
+    for (size_t n = 0; n < from.size(); n++) {
+        const char * text = &texts[textStart[from[n]]];
+        bool pass = ! grep;
+        for (size_t i = 0; i < terms.size(); i++) {
+            if (strstr(text, terms[i].c_str())) {
+                pass = ! subtract[i];
+                break;
+            }
+        }
+        if (pass) {
+            passed.push_back(from[n]);
+        }
+    }
+    rows.swap(passed);
+}
+
+// sort and filter again if the IOCs, the sort column or the query changed
+void IocTable::update(std::vector<Ioc *> & _list, unsigned _generation) {
+    PROFILE_ZONE("IocTable::update");
+    if (generation != _generation) {
+        buildTexts(_list);
+    }
+    if (! sorted || generation != _generation) {
+        sort(_list);
+        generation = _generation;
+        filterRows(false);
+    } else if (strcmp(rowsQuery, filter.InputBuf) != 0) {
+        filterRows(refines(rowsQuery, filter.InputBuf));
+    }
+}
+
+static void drawIocTable(IocList * _iocs) {
+    PROFILE_ZONE("drawIocTable");
+    IocTable & table = _iocs->table;
+
+    // header stays put while the rows scroll; click to sort
+    static const char * headers[IOC_COLUMNS] = { "ID", "Name", "Prefix", "Started", "Errors", "Last error", "Open" };
+    float originX = ImGui::GetCursorScreenPos().x;
+    ImGui::Columns(IOC_COLUMNS, "iocheader", false);
+    for (int n = 1; n < IOC_COLUMNS && table.offsets[IOC_COLUMNS - 1] > 0.0f; n++) {
+        ImGui::SetColumnOffset(n, originX + table.offsets[n] - ImGui::GetWindowPos().x);
+    }
+    ImGui::Separator();
+    for (int n = 0; n < IOC_COLUMNS; n++) {
+        char label[32];
+        const char * arrow = "";
+        if (n == table.sortColumn) {
+            arrow = table.sortDescending ? " v" : " ^";
+        }
+        snprintf(label, sizeof(label), "%s%s", headers[n], arrow);
+        if (n == IOC_COLUMN_LAST_ERROR || n == IOC_COLUMN_OPEN) {
+            ImGui::Text("%s", label);
+        } else if (ImGui::Selectable(label, n == table.sortColumn)) {
+            table.sortBy(n);
+        }
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+    ImGui::Separator();
+
+    ImGui::BeginChild("iocrows");
+    ImGui::Columns(IOC_COLUMNS, "iocrows");
+    ImGuiListClipper clipper;
+    clipper.Begin(table.rows.size());
+    while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+            size_t n = table.rows[row];
+            Ioc * ioc = _iocs->ioc(n);
+            ImGui::PushID(ioc);
+            ImGui::Text("%04ld", n); ImGui::NextColumn();
+            ImGui::Text("%s", ioc->deviceName); ImGui::NextColumn();
+            if (ioc->prefixConflict) {
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%s", ioc->prefix);
+                if (ImGui::IsItemHovered()) {
+                    const std::vector<Ioc *> * same = _iocs->index.findPrefix(ioc->prefix);
+                    ImGui::BeginTooltip();
+                    ImGui::Text("PV prefix conflict, also used by:");
+                    for (size_t i = 0; same && i < same->size(); i++) {
+                        if ((*same)[i] != ioc) {
+                            ImGui::Text("%s", (*same)[i]->instancePath);
+                        }
+                    }
+                    ImGui::EndTooltip();
+                }
+            } else {
+                ImGui::Text("%s", ioc->prefix);
+            }
+            ImGui::NextColumn();
+            if (ioc->stale) {
+                ImGui::TextColored(ImVec4(1.0f, 0.75f, 0.25f, 1.0f), "%s", ioc->started ? "YES, gone" : "NO, gone");
+                if (ImGui::IsItemHovered()) {
+                    ImGui::SetTooltip("instance no longer found, removed once stopped");
+                }
+            } else {
+                ImGui::Text("%s", ioc->started ? "YES" : "NO");
+            }
+            ImGui::NextColumn();
+            if (ioc->errors()) {
+                ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%zu", ioc->errors());
+                ImGui::SameLine();
+            }
+            if (ioc->warnings()) {
+                ImGui::TextColored(ImVec4(1.0f, 0.75f, 0.25f, 1.0f), "%zu", ioc->warnings());
+            }
+            ImGui::NextColumn();
+            ChildData * last = ioc->lastError();
+            if (last) {
+                ImGui::TextUnformatted(last->lastError);
+                if (ImGui::IsItemHovered()) {
+                    time_t sec = last->lastErrorWall / 1000000;
+                    struct tm tm;
+                    localtime_r(&sec, &tm);
+                    ImGui::SetTooltip("%s at %02d:%02d:%02d\n%s", last->name, tm.tm_hour, tm.tm_min, tm.tm_sec, last->lastError);
+                }
+            }
+            ImGui::NextColumn();
+            if (ImGui::SmallButton("Open")) {
+                ioc->open = true;
+            }
+            ImGui::NextColumn();
+            ImGui::PopID();
+        }
+    }
+    clipper.End();
+    float rowsX = ImGui::GetWindowPos().x;
+    for (int n = 0; n < IOC_COLUMNS; n++) {
+        table.offsets[n] = rowsX + ImGui::GetColumnOffset(n) - originX;
+    }
+    ImGui::Columns(1);
+    ImGui::EndChild();
+}
+
 void launcherDraw(IocList * _iocs) {
+    PROFILE_ZONE("launcherDraw");
     IM_ASSERT(_iocs != NULL);
 
     ImGui::Begin("Main Window");
 
-    // set the top IOC path
-    if (strlen(_iocs->topPath) == 0) {
-        strncpy(_iocs->topPath, "/data/bdee", 512);
+    // IOC roots, each one kept up to date on its own
+    if (ImGui::CollapsingHeader("IOC roots", ImGuiTreeNodeFlags_DefaultOpen)) {
+        IocRoot * removed = NULL;
+        double now = launcherTime();
+        for (size_t n = 0; n < _iocs->roots.size(); n++) {
+            IocRoot * root = _iocs->roots[n];
+            bool changed = false;
+            ImGui::PushID(root);
+            ImGui::Text("%s", root->path);
+            ImGui::SameLine();
+            ImGui::PushItemWidth(90);
+            changed |= ImGui::Combo("##strategy", &root->strategy, "auto\0watch\0periodic\0");
+            ImGui::SameLine();
+            // the drags change the value on every frame, it is applied once
+            // the drag is done
+            float period = root->scanPeriod;
+            if (ImGui::DragFloat("s##period", &period, 1.0f, 10.0f, 3600.0f, "%.0f")) {
+                root->scanPeriod = period;
+            }
+            changed |= ImGui::IsItemDeactivatedAfterEdit();
+            ImGui::SameLine();
+            ImGui::DragInt("threads", &root->maxThreads, 0.1f, 1, 32);
+            changed |= ImGui::IsItemDeactivatedAfterEdit();
+            ImGui::PopItemWidth();
+            ImGui::SameLine();
+            if (ImGui::SmallButton("Scan")) {
+                _iocs->startScan(root);
+            }
+            ImGui::SameLine();
+            if (ImGui::SmallButton("Remove")) {
+                removed = root;
+            }
+            ImGui::SameLine();
+            if (root->scan) {
+                ImGui::Text("%zu IOCs, scanning .. %.1f s", root->iocs, now - root->scan->startTime);
+            } else if (root->periodic()) {
+                ImGui::Text("%zu IOCs, walk took %.1f s (%zu stat calls), next in %.0f s", root->iocs, root->scanTime,
+                    root->scanStats, root->scanPeriod - (now - root->lastScan));
+            } else if (root->watcher.active) {
+                ImGui::Text("%zu IOCs, watching %zu folders (%s), walk took %zu stat calls", root->iocs,
+                    root->watcher.count(), root->watcher.polling ? "polling" : "inotify", root->scanStats);
+            } else {
+                ImGui::Text("%zu IOCs", root->iocs);
+            }
+            if (changed) {
+                // switching between the watch and the walk takes a new scan
+                _iocs->saveRoots();
+                _iocs->startScan(root);
+            }
+            ImGui::PopID();
+        }
+        if (removed) {
+            _iocs->removeRoot(removed);
+            _iocs->saveRoots();
+        }
+
+        bool add = ImGui::InputText("##newroot", _iocs->newRoot, IM_ARRAYSIZE(_iocs->newRoot), ImGuiInputTextFlags_EnterReturnsTrue);
+        ImGui::SameLine();
+        if (ImGui::Button("Add root")) {
+            add = true;
+        }
+        if (add) {
+            IocRoot * root = _iocs->addRoot(_iocs->newRoot, ROOT_AUTO, 300.0, 4);
+            if (root) {
+                _iocs->saveRoots();
+                _iocs->startScan(root);
+                _iocs->newRoot[0] = '\0';
+            }
+        }
     }
-    ImGui::InputText("IOCs location", _iocs->topPath, IM_ARRAYSIZE(_iocs->topPath));
 
     if (ImGui::Button("Scan for IOCs")) {
-        // removes all the IOC objects
-        // XXX what happens to the ones that are started?
-        _iocs->clear();
-        _iocs->populate();
+        // walk the trees in the background; unchanged IOCs are kept, the ones
+        // that are gone are removed once they are stopped, and only after a
+        // walk that could list every folder
+        for (size_t n = 0; n < _iocs->roots.size(); n++) {
+            _iocs->startScan(_iocs->roots[n]);
+        }
+    }
+    // pick up new, removed and edited instances
+    _iocs->update();
+    _iocs->recvResponses();
+    if (_iocs->index.conflicts) {
+        ImGui::SameLine();
+        ImGui::TextColored(ImVec4(1.0f, 0.4f, 0.4f, 1.0f), "%zu PV prefix conflicts", _iocs->index.conflicts);
     }
 
-    if (_iocs->count() > 0) {
-        ImGui::Columns(5, "mycolumns");
-        ImGui::Separator();
-        ImGui::Text("ID"); ImGui::NextColumn();
-        ImGui::Text("Name"); ImGui::NextColumn();
-        ImGui::Text("Prefix"); ImGui::NextColumn();
-        ImGui::Text("Started"); ImGui::NextColumn();
-        ImGui::Text("Open"); ImGui::NextColumn();
-        ImGui::Separator();
-        for (size_t n = 0; n < _iocs->count(); n++) {
-            ImGui::PushID(n);
-            ImGui::Text("%04ld", n); ImGui::NextColumn();
-            Ioc * ioc = _iocs->ioc(n);
-            ImGui::Text("%s", ioc->deviceName); ImGui::NextColumn();
-            ImGui::Text("%s", ioc->prefix); ImGui::NextColumn();
-            ImGui::Text("%s", ioc->started ? "YES" : "NO"); ImGui::NextColumn();
-            if (ImGui::Button("Open")) {
+    // frame pacing, see launcherWait()
+    ImGui::Checkbox("Sleep when idle", &_iocs->loop.idle);
+    ImGui::SameLine();
+    ImGui::PushItemWidth(80);
+    ImGui::DragInt("max FPS", &_iocs->loop.maxFps, 0.2f, 0, 240, _iocs->loop.maxFps ? "%d" : "no limit");
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    ImGui::Text("%u frames/min", _iocs->loop.framesPerMinute());
+    ImGui::SameLine();
+    ImGui::Checkbox("Profiler", &_iocs->showProfiler);
+    ImGui::SameLine();
+    ImGui::Checkbox("Timeline", &_iocs->timeline.open);
+
+    // marker lines of all the IOCs, see Ioc::sendProbe()
+    if (_iocs->latencyModes.size() && ImGui::CollapsingHeader("Output latency")) {
+        for (auto it = _iocs->latencyModes.begin(); it != _iocs->latencyModes.end(); ++it) {
+            if (it->second.count || it->second.missed) {
+                ImGui::Text("%s", it->first.c_str());
+                ImGui::Indent();
+                it->second.draw();
+                ImGui::Unindent();
+            }
+        }
+    }
+
+    // react to strings in the output of any IOC
+    if (ImGui::CollapsingHeader("Triggers")) {
+        _iocs->drawTriggers();
+    }
+
+    // find the IOC serving a PV, or all the IOCs under a partial prefix
+    bool searchChanged = ImGui::InputText("Find PV / prefix", _iocs->searchText, IM_ARRAYSIZE(_iocs->searchText));
+    if (strlen(_iocs->searchText)) {
+        if (searchChanged || _iocs->searchGeneration != _iocs->index.generation) {
+            _iocs->searchTotal = _iocs->index.search(_iocs->searchText, _iocs->searchOwners, _iocs->searchMatches, 20);
+            _iocs->searchGeneration = _iocs->index.generation;
+        }
+        ImGui::Indent();
+        for (size_t n = 0; n < _iocs->searchOwners.size(); n++) {
+            Ioc * ioc = _iocs->searchOwners[n];
+            ImGui::PushID(ioc);
+            if (ImGui::SmallButton("Open")) {
                 ioc->open = true;
             }
-            ImGui::NextColumn();
-            // show the IOC control window
-            if (ioc->open) {
-                ioc->show(&ioc->open);
+            ImGui::SameLine();
+            ImGui::Text("served by %s (%s) in %s", ioc->deviceName, ioc->prefix, ioc->stagePath);
+            ImGui::PopID();
+        }
+        for (size_t n = 0; n < _iocs->searchMatches.size(); n++) {
+            Ioc * ioc = _iocs->searchMatches[n];
+            ImGui::PushID(ioc);
+            if (ImGui::SmallButton("Open")) {
+                ioc->open = true;
             }
+            ImGui::SameLine();
+            ImGui::Text("%s %s", ioc->prefix, ioc->deviceName);
             ImGui::PopID();
         }
-        ImGui::Columns(1);
+        if (_iocs->searchTotal > _iocs->searchMatches.size()) {
+            ImGui::TextDisabled("%zu more ..", _iocs->searchTotal - _iocs->searchMatches.size());
+        }
+        ImGui::Unindent();
+    }
+
+    if (_iocs->count() > 0) {
+        // narrow down the table: "flir,basler", "-stopped", ..
+        _iocs->table.filter.Draw("Filter name, prefix, stage, state (inc,-exc)", 300.0f);
+        _iocs->table.update(_iocs->list, _iocs->index.generation);
+        if (_iocs->table.filter.IsActive()) {
+            ImGui::SameLine();
+            ImGui::Text("%zu of %zu IOCs", _iocs->table.rows.size(), _iocs->count());
+        }
+        drawIocTable(_iocs);
     } // iocs->count() > 0)
 
     ImGui::End();
+
+    // show the IOC control windows, whether their rows are visible or not
+    for (size_t n = 0; n < _iocs->count(); n++) {
+        Ioc * ioc = _iocs->ioc(n);
+        if (ioc->open) {
+            ioc->show(&ioc->open);
+            _iocs->timeline.sync(ioc);
+        }
+    }
+    if (_iocs->timeline.open) {
+        _iocs->timeline.draw();
+    }
+
+    _iocs->updateProbes();
+
+    if (_iocs->showProfiler) {
+        profilerDraw(&_iocs->showProfiler);
+    }
+    profilerEnabled = _iocs->showProfiler;
 }
 
 void launcherDestroy(IocList * _iocs) {
     D("out of the loop\n");
     if (_iocs) {
+        // keep the incremental changes for the next session, unless some
+        // root is still being scanned
+        bool scanning = false;
+        for (size_t n = 0; n < _iocs->roots.size(); n++) {
+            scanning = scanning || _iocs->roots[n]->scan;
+        }
+        if (! scanning) {
+            _iocs->saveCache();
+        }
         delete _iocs;
     }
 }
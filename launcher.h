@@ -2,11 +2,24 @@
 #define LAUNCHER_H
 
 #include "imgui.h"
+#include "macros.h"
+#include "profiler.h"
 
 #include <unistd.h>
 #include <string.h>
 #include <stdlib.h>
+#include <time.h>
+#include <dirent.h>
 #include <vector>
+#include <thread>
+#include <atomic>
+#include <set>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
 
 // some handy macros for printing to stderr
 #define E(fmt, ...)         do { fprintf(stderr, "%s:%d ** ERROR ** " fmt, __FUNCTION__, __LINE__, ##__VA_ARGS__); } while (0)
@@ -18,23 +31,479 @@
     #define D(fmt, ...)         do{}while(0)
 #endif
 
+bool isNetworkFs(const char * _path);
+bool isBelowAny(const char * _path, const std::unordered_set<std::string> & _parents);
+
+// folder entry, see readDirEntries()
+struct IocDirEntry {
+    char name[256];
+    // DT_DIR, DT_REG, .. of the symlink target; DT_UNKNOWN if dangling
+    unsigned char type;
+};
+size_t readDirEntries(DIR * _dir, std::vector<IocDirEntry> & _entries, std::atomic<int> * _spare);
+bool launcherUserDir(const char * _xdg, const char * _home, char * _dir, size_t _size, bool _create);
+
+// monotonic time in seconds
+static inline double launcherTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static inline bool sameMtime(const struct timespec & _a, const struct timespec & _b) {
+    return _a.tv_sec == _b.tv_sec && _a.tv_nsec == _b.tv_nsec;
+}
+
+// an output line with this marker, followed by the CLOCK_MONOTONIC time in
+// nanoseconds it was written at, measures how long output takes to get from
+// the IOC to the screen; see Ioc::sendProbe(), tools/fakeioc prints them too
+#define LATENCY_MARKER          "@latency="
+// samples kept per IOC and per main loop mode
+#define LATENCY_SAMPLES         512
+// marker lines not shown within this many seconds are given up on
+#define LATENCY_TIMEOUT         10.0
+
+// marker line on its way to the screen
+struct LatencyProbe {
+    int line;
+    double written;
+    double ingested;
+};
+
+// the last LATENCY_SAMPLES latencies of marker lines, in ms
+struct LatencyStats {
+    // written to read from the pipe
+    std::vector<float> ingest;
+    // written to first drawn in a visible part of the log
+    std::vector<float> visible;
+    size_t next;
+    size_t count;
+    size_t missed;
+
+    LatencyStats() {
+        clear();
+    }
+    void clear(void) {
+        ingest.clear();
+        visible.clear();
+        next = 0;
+        count = 0;
+        missed = 0;
+    }
+    void add(float _ingest, float _visible) {
+        if (ingest.size() < LATENCY_SAMPLES) {
+            ingest.push_back(_ingest);
+            visible.push_back(_visible);
+        } else {
+            ingest[next] = _ingest;
+            visible[next] = _visible;
+        }
+        next = (next + 1) % LATENCY_SAMPLES;
+        count++;
+    }
+    void draw(void);
+};
+
+// lines between two full timestamps, power of two
+#define LOG_CHECKPOINT_LINES    256
+
+// monotonic ingest time of every log line, in microseconds: a full time
+// every LOG_CHECKPOINT_LINES lines and varint deltas from the previous line
+// in between, so a line costs a byte or two
+struct LogStamps {
+    struct Checkpoint {
+        uint64_t mono;
+        // wall clock minus monotonic clock, at the time of the checkpoint
+        int64_t wallOffset;
+        uint32_t offset;
+    };
+    std::vector<Checkpoint> checkpoints;
+    std::vector<unsigned char> deltas;
+    size_t count;
+    uint64_t last;
+    // where the last lookup ended, lines are mostly read in order
+    size_t cursorLine;
+    size_t cursorOffset;
+    uint64_t cursorMono;
+
+    LogStamps() {
+        clear();
+    }
+    void clear(void) {
+        checkpoints.clear();
+        deltas.clear();
+        count = 0;
+        last = 0;
+        cursorLine = (size_t)-1;
+    }
+    void add(uint64_t _mono);
+    uint64_t mono(size_t _line);
+    int64_t wallOffset(size_t _line) {
+        return checkpoints[_line / LOG_CHECKPOINT_LINES].wallOffset;
+    }
+    size_t find(uint64_t _mono);
+};
+
+// ChildData::colorIndex of a 256 color or 24 bit color
+#define ANSI_COLOR_RGB          16
+
+// colored part of a log line, the escape sequences that set the color are
+// taken out of the text when the line is read
+struct ColorSpan {
+    uint32_t line;
+    // within the line
+    uint16_t offset;
+    uint16_t length;
+    ImU32 color;
+};
+
+// severity of a log line, higher is worse
+enum {
+    SEVERITY_NONE = 0,
+    SEVERITY_WARNING,
+    SEVERITY_ERROR,
+};
+
+// finds any of a set of patterns in log lines, case insensitive: an
+// Aho-Corasick automaton over the pattern bytes, so a line is read once
+// whatever the number of patterns
+struct PatternMatcher {
+    // lower case pattern and its value, above 0, as added
+    std::vector<std::pair<std::string, int>> patterns;
+    // bytes in no pattern share class 0, upper case the lower case class
+    unsigned char classes[256];
+    int classCount;
+    // next state, by state and class; states are kept as their row in the
+    // table, state times classCount, to save a multiply per byte
+    std::vector<int> next;
+    // highest value of the patterns ending in a state, up to 255, by row
+    std::vector<unsigned char> output;
+    // values of all the patterns ending in a state, by state
+    std::vector<int> first;
+    std::vector<int> hits;
+
+    PatternMatcher() {
+        memset(classes, 0, sizeof(classes));
+        classCount = 1;
+        next.assign(1, 0);
+        output.assign(1, 0);
+        first.assign(2, 0);
+    }
+    void clear(void) {
+        patterns.clear();
+    }
+    void add(const char * _pattern, int _value);
+    void build(void);
+    // highest value of the patterns in _line, stops looking at _enough
+    int highest(const char * _line, int _enough) {
+        int state = 0;
+        int value = 0;
+        for (const unsigned char * p = (const unsigned char *)_line; *p; p++) {
+            state = next[state + classes[*p]];
+            if (output[state] > value) {
+                value = output[state];
+                if (value >= _enough) {
+                    break;
+                }
+            }
+        }
+        return value;
+    }
+    // calls _hit(value) for every pattern found in _line
+    template <typename Hit>
+    void scan(const char * _line, Hit _hit) {
+        int state = 0;
+        for (const unsigned char * p = (const unsigned char *)_line; *p; p++) {
+            state = next[state + classes[*p]];
+            if (output[state]) {
+                int n = state / classCount;
+                for (int hit = first[n]; hit < first[n + 1]; hit++) {
+                    _hit(hits[hit]);
+                }
+            }
+        }
+    }
+};
+
+// what a trigger does, or'ed
+enum {
+    TRIGGER_HIGHLIGHT = 1,
+    TRIGGER_NOTIFY = 2,
+    TRIGGER_RESTART = 4,
+    TRIGGER_COMMAND = 8,
+};
+
+// reaction to a string showing up in the output of any IOC
+struct Trigger {
+    char pattern[128];
+    unsigned int actions;
+    // iocsh command for TRIGGER_COMMAND, with the macros of the IOC
+    char command[256];
+    // the actions other than highlight run again for the same IOC only
+    // after this many seconds
+    float holdoff;
+    size_t fired;
+    // IOC and line of the last time it fired
+    char last[256];
+
+    Trigger() {
+        pattern[0] = '\0';
+        actions = TRIGGER_HIGHLIGHT;
+        command[0] = '\0';
+        holdoff = 60.0f;
+        fired = 0;
+        last[0] = '\0';
+    }
+};
+
+// a trigger pattern found in a line, waiting for IocList::fireTriggers()
+struct TriggerHit {
+    int trigger;
+    uint32_t line;
+};
+
+// a line said again right after itself, maybe with other numbers: the
+// first one is stored as any line, the repeats only as their numbers and
+// times, see ChildData::addRepeat()
+struct LogRepeat {
+    uint32_t line;
+    // repeats after the first one
+    uint32_t count;
+    uint64_t lastMono;
+    // digit runs of every repeat, a space after each run and a newline
+    // after each repeat
+    std::string numbers;
+    // varint microseconds from the one before, of every repeat
+    std::vector<unsigned char> times;
+};
+
+// lines per segment of the search index, and per block of a segment; a
+// segment has 64 blocks
+#define LOG_SEGMENT_LINES       4096
+#define LOG_BLOCK_LINES         64
+
+// every three bytes seen in the lines of a segment, case folded, with the
+// blocks they are in, a bit per block; lines are added to a hash table,
+// full segments are turned into sorted arrays
+struct LogTrigram {
+    uint32_t trigram;
+    uint64_t blocks;
+};
+struct LogSegment {
+    std::vector<LogTrigram> trigrams;
+    size_t used;
+    // log2 of the hash table size, 0 once sorted
+    int bits;
+
+    LogSegment() {
+        used = 0;
+        bits = 0;
+    }
+    void add(uint32_t _trigram, uint64_t _block);
+    uint64_t find(uint32_t _trigram);
+    void seal(void);
+};
+
+// trigram index of the lines of a log, built as they are read; a search
+// only looks at the blocks that have all the trigrams of the text it wants
+struct LogIndex {
+    std::vector<LogSegment> segments;
+    size_t lines;
+    // trigrams already in the current block, most are in every line of it
+    std::vector<uint32_t> recent;
+
+    LogIndex() {
+        clear();
+    }
+    void clear(void) {
+        segments.clear();
+        recent.clear();
+        lines = 0;
+    }
+    void add(const char * _line, size_t _length);
+    // blocks of a segment that may have _text, case folded
+    uint64_t candidates(size_t _segment, const std::string & _text);
+    size_t bytes(void);
+};
+
+// compiled search, see search.cpp
+struct LogQuery;
+
+// lines the filter looks at between checks of its time budget
+#define LOG_FILTER_LINES        4096
+
+// first place of _text, lower case, in [_from, _to) in any case
+const char * logFind(const char * _from, const char * _to, const std::string & _text);
+
+// a line goes with a template when this much of the tokens the template
+// has, other than its wildcards, are the same
+#define LOG_TEMPLATE_SIMILARITY 0.5
+// values kept per wildcard of a template, lines refer to them by number
+#define LOG_TEMPLATE_VALUES     64
+
+// the tokens between the spaces of a line, some of them wildcards that
+// each line fills in
+struct LogTemplate {
+    std::vector<std::string> tokens;
+    std::vector<bool> wild;
+    int cluster;
+    // values the wildcards took, by token
+    std::vector<std::vector<std::string>> values;
+    std::vector<std::unordered_map<std::string, int>> valueIds;
+};
+
+// lines clustered by their format as they come in, the way Drain does:
+// the lines of a cluster have as many tokens and the same first tokens
+// (those are the levels of the Drain tree, here the key of a hash), and
+// mostly the same other tokens; the tokens that differ become wildcards.
+// The lines are packed as a template number and a value for every
+// wildcard, see LogTemplates::add()
+struct LogTemplates {
+    // a template is not changed once a line uses it, a cluster gets a new
+    // one with more wildcards
+    std::vector<LogTemplate> templates;
+    // by cluster
+    std::vector<int> clusterTemplate;
+    std::vector<size_t> clusterLines;
+    std::unordered_map<std::string, std::vector<int>> groups;
+    std::vector<unsigned char> packed;
+    // tokens of the line being added
+    std::vector<std::pair<const char *, size_t>> split;
+
+    void clear(void) {
+        templates.clear();
+        clusterTemplate.clear();
+        clusterLines.clear();
+        groups.clear();
+        packed.clear();
+    }
+    void add(const char * _line, size_t _length);
+    void text(size_t _offset, std::string & _text);
+    int cluster(size_t _offset);
+    std::string pattern(int _cluster);
+    size_t bytes(void);
+};
+
+// microseconds
+static inline uint64_t logTime(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 struct ChildData {
     char name[16];
+    // IOC and stream, for the trace
+    char label[80];
     int fd;
     char buffer[4096];
     size_t size;
     size_t lines;
     ImGuiTextBuffer linesBuffer;
+    // lines kept as templates and values instead of text, in templates
+    bool compact;
+    LogTemplates templates;
+    // text of the last line unpacked, see lineText()
+    std::string lineScratch;
+    // where each line starts in linesBuffer, or templates.packed; only the
+    // visible ones are drawn
+    ImVector<int> lineOffsets;
+    // when each line was read
+    LogStamps stamps;
+    // arrival order of every line among the lines of both streams of the
+    // IOC, from the counter the two share
+    std::vector<uint32_t> sequence;
+    uint32_t * nextSequence;
+    uint32_t ownSequence;
+    // colored parts of the lines, by line; only the lines with some color
+    // have any
+    std::vector<ColorSpan> spans;
+    // ANSI color in effect, it carries over to the next line: a palette
+    // index, -1 for the default color or ANSI_COLOR_RGB for a color given
+    // by number
+    int colorIndex;
+    bool colorBold;
+    ImU32 color;
+    // text of the last line with the escape sequences taken out
+    std::string colorLine;
+    // repeats of the lines, by line; only the lines said again have any
+    std::vector<LogRepeat> repeats;
+    bool collapseRepeats;
+    // line with its repeats shown
+    int expandLine;
+    // classifies the lines as they come in, if set
+    PatternMatcher * matcher;
+    // finds the trigger patterns in the lines, if set
+    PatternMatcher * triggers;
+    std::vector<TriggerHit> triggerHits;
+    // lines picked out by a trigger
+    std::vector<uint32_t> highlightLines;
+    // lines classified as errors and warnings
+    std::vector<uint32_t> errorLines;
+    std::vector<uint32_t> warningLines;
+    // since the IOC was started, clearing the log does not reset them
+    size_t errors;
+    size_t warnings;
+    char lastError[256];
+    uint64_t lastErrorMono;
+    int64_t lastErrorWall;
+    bool showStamps;
+    // shown in the timeline window
+    bool inTimeline;
+    // search box: text or regex, the lines found so far and the one shown
+    LogIndex searchIndex;
+    char searchText[128];
+    bool searchRegex;
+    LogQuery * query;
+    std::vector<uint32_t> matches;
+    size_t searched;
+    int currentMatch;
+    double searchTime;
+    // filter box: only the lines with the text are shown, these ones
+    char filterText[128];
+    std::string filterNeedle;
+    std::vector<uint32_t> filtered;
+    size_t filterScanned;
+    // only the lines of this template cluster, -1 for all
+    int filterCluster;
+    // jump to time input, and the line to scroll to next frame
+    char jumpText[16];
+    int jumpLine;
     bool autoScroll;
     bool scrollToBottom;
+    // marker lines not shown yet, and the ones shown since the last frame
+    std::vector<LatencyProbe> probes;
+    std::vector<std::pair<float, float>> measured;
+    unsigned long long lastMarker;
 
     ChildData() {
         name[0] = '\0';
+        label[0] = '\0';
         fd = -1;
+        nextSequence = &ownSequence;
+        ownSequence = 0;
+        collapseRepeats = true;
+        matcher = NULL;
+        triggers = NULL;
+        resetCounts();
         autoScroll = true;
         scrollToBottom = false;
+        lastMarker = 0;
+        showStamps = false;
+        inTimeline = false;
+        searchText[0] = '\0';
+        searchRegex = false;
+        query = NULL;
+        filterText[0] = '\0';
+        filterCluster = -1;
+        compact = false;
+        jumpText[0] = '\0';
+        jumpLine = -1;
         clear();
     }
+    ~ChildData() {
+        endSearch();
+    }
 
     void setName(const char * _name) {
         strncpy(name, _name, 15);
@@ -45,19 +514,195 @@ struct ChildData {
         size = 0;
         lines = 0;
         linesBuffer.clear();
+        templates.clear();
+        lineOffsets.clear();
+        stamps.clear();
+        sequence.clear();
+        errorLines.clear();
+        warningLines.clear();
+        triggerHits.clear();
+        highlightLines.clear();
+        spans.clear();
+        repeats.clear();
+        expandLine = -1;
+        searchIndex.clear();
+        matches.clear();
+        searched = 0;
+        currentMatch = -1;
+        searchTime = 0.0;
+        filtered.clear();
+        filterScanned = 0;
+        colorIndex = -1;
+        colorBold = false;
+        color = 0;
+        probes.clear();
     }
 
-    void addLine(const char * _line) {
-        linesBuffer.appendf("%s", _line);
+    void addLine(const char * _line, uint64_t _mono = 0) {
+        if (color || strchr(_line, '\x1b')) {
+            _line = parseColors(_line);
+        }
+        uint64_t mono = _mono ? _mono : logTime();
         lines++;
+        // a repeat still counts, and fires triggers, as the line it repeats
+        if (! (collapseRepeats && addRepeat(_line, mono))) {
+            stamps.add(mono);
+            sequence.push_back((*nextSequence)++);
+            size_t length = strlen(_line);
+            if (compact) {
+                lineOffsets.push_back(templates.packed.size());
+                templates.add(_line, (length && _line[length - 1] == '\n') ? length - 1 : length);
+            } else {
+                lineOffsets.push_back(linesBuffer.size());
+                linesBuffer.append(_line, _line + length);
+            }
+            searchIndex.add(_line, length);
+        }
+        if (matcher) {
+            classify(_line, mono);
+        }
+        if (triggers && triggers->patterns.size()) {
+            uint32_t line = lineOffsets.Size - 1;
+            triggers->scan(_line, [this, line](int _trigger) {
+                triggerHits.push_back(TriggerHit{_trigger - 1, line});
+            });
+        }
+        const char * marker = strstr(_line, LATENCY_MARKER);
+        if (marker) {
+            addProbe(marker + strlen(LATENCY_MARKER));
+        }
     }
 
+    // text of a line without the newline; when compact it is good until
+    // the next call
+    const char * lineText(int _line, const char ** _end) {
+        if (compact) {
+            templates.text(lineOffsets[_line], lineScratch);
+            *_end = lineScratch.c_str() + lineScratch.size();
+            return lineScratch.c_str();
+        }
+        const char * start = linesBuffer.begin() + lineOffsets[_line];
+        const char * end = (_line + 1 < lineOffsets.Size) ? linesBuffer.begin() + lineOffsets[_line + 1] : linesBuffer.end();
+        if (end > start && end[-1] == '\n') {
+            end--;
+        }
+        *_end = end;
+        return start;
+    }
+    size_t textBytes(void) {
+        return compact ? templates.bytes() : linesBuffer.size();
+    }
+    void setCompact(bool _compact);
+    void drawTemplates(void);
+    void addProbe(const char * _stamp);
     void extractLines(void);
-    int recvResponse(void);
+    // lines with a sequence number below _sequence
+    size_t before(uint32_t _sequence) {
+        return std::lower_bound(sequence.begin(), sequence.end(), _sequence) - sequence.begin();
+    }
+    void resetCounts(void) {
+        errors = 0;
+        warnings = 0;
+        lastError[0] = '\0';
+        lastErrorMono = 0;
+        lastErrorWall = 0;
+    }
+    void classify(const char * _line, uint64_t _mono);
+    bool addRepeat(const char * _line, uint64_t _mono);
+    LogRepeat * findRepeat(int _line) {
+        if (repeats.empty() || repeats.back().line < (uint32_t)_line) {
+            return NULL;
+        }
+        auto it = std::lower_bound(repeats.begin(), repeats.end(), (uint32_t)_line, [](const LogRepeat & a, uint32_t b) {
+            return a.line < b;
+        });
+        return (it != repeats.end() && it->line == (uint32_t)_line) ? &*it : NULL;
+    }
+    void drawRepeats(void);
+    const char * parseColors(const char * _line);
+    void applySgr(const int * _params, int _count);
+    int recvResponse(short _revents);
+    void jumpTo(const char * _time);
+    void search(void);
+    void updateSearch(double _budget);
+    void endSearch(void);
+    void nextMatch(int _step);
+    void drawSearch(void);
+    void filter(void);
+    bool filterLine(int _line);
+    void updateFilter(double _budget);
+    void drawFilterMatches(const char * _start, const char * _end);
+    void drawFilter(void);
+    void drawControls(void);
+    void drawText(int _line);
+    void drawLine(int _line);
+    void drawLines(void);
+};
+
+struct Ioc;
+struct IocRoot;
+
+// node of the PV prefix trie; children are kept as a sibling list
+struct IocTrieNode {
+    char c;
+    int firstChild;
+    int nextSibling;
+    // IOCs with prefix ending here / in this sub-tree
+    int iocs;
+    int subtree;
+};
+
+// lookup of IOCs by PV prefix, device name and instance path, kept up to
+// date as IOCs are added, changed and removed; prefixes used by more than
+// one IOC are flagged as conflicts
+struct IocIndex {
+    std::unordered_map<std::string, std::vector<Ioc *> > byPrefix;
+    std::unordered_map<std::string, std::vector<Ioc *> > byDevice;
+    std::unordered_map<std::string, Ioc *> byPath;
+    // same instance folder reached through different roots or links
+    std::unordered_map<std::string, Ioc *> byInode;
+    std::vector<IocTrieNode> trie;
+    size_t conflicts;
+    // bumped on every change, and when an IOC is started or stopped
+    unsigned generation;
+
+    IocIndex() {
+        generation = 0;
+        clear();
+    }
+    void clear(void) {
+        byPrefix.clear();
+        byDevice.clear();
+        byPath.clear();
+        byInode.clear();
+        trie.clear();
+        trie.push_back(IocTrieNode{'\0', -1, -1, 0, 0});
+        conflicts = 0;
+        generation++;
+    }
+    void insert(Ioc * _ioc);
+    void remove(Ioc * _ioc);
+    Ioc * findPath(const char * _instancePath) {
+        auto it = byPath.find(_instancePath);
+        return (it != byPath.end()) ? it->second : NULL;
+    }
+    Ioc * findInode(dev_t _dev, ino_t _ino);
+    const std::vector<Ioc *> * findPrefix(const char * _prefix) {
+        auto it = byPrefix.find(_prefix);
+        return (it != byPrefix.end()) ? &it->second : NULL;
+    }
+    const std::vector<Ioc *> * findDevice(const char * _deviceName) {
+        auto it = byDevice.find(_deviceName);
+        return (it != byDevice.end()) ? &it->second : NULL;
+    }
+    size_t search(const char * _text, std::vector<Ioc *> & _owners, std::vector<Ioc *> & _matches, size_t _max);
+    int trieAdd(const char * _prefix, int _delta);
+    void trieCollect(int _node, std::string & _prefix, std::vector<Ioc *> & _matches, size_t _max);
 };
 
 struct Ioc {
     char * stagePath;
+    char * instancePath;
     char * instanceName;
     char * deviceName;
     char * prefix;
@@ -70,9 +715,37 @@ struct Ioc {
     ChildData childStdout;
     ChildData childStderr;
     bool open;
+    // instance folder and instance.cmd mtimes at the time it was parsed
+    struct timespec dirMtime;
+    struct timespec cmdMtime;
+    bool seen;
+    // its instance is gone, kept while it runs; see IocList::dropIoc()
+    bool stale;
+    // resolved epicsEnvSet() macros from st.cmd / instance.cmd
+    MacroTable macros;
+    bool macrosComplete;
+    MacroEngine * engine;
+    IocIndex * index;
+    // another IOC uses the same PV prefix
+    bool prefixConflict;
+    // root the IOC was found in, instance folder identity
+    IocRoot * root;
+    dev_t dev;
+    ino_t ino;
+    // output latency, measured with marker lines
+    LatencyStats latency;
+    bool probing;
+    double nextProbe;
+    // when each trigger last ran its actions for this IOC, by trigger
+    std::vector<double> triggerTimes;
+    // shared by the stdout and stderr lines
+    uint32_t sequence;
+    // stdout and stderr in one pane, in the order they came in
+    bool combined;
 
-    Ioc(const char * _stagePath, const char * _instanceName, const char * _deviceName, const char * _prefix) {
+    Ioc(const char * _stagePath, const char * _instancePath, const char * _instanceName, const char * _deviceName, const char * _prefix) {
         stagePath = strdup(_stagePath);
+        instancePath = strdup(_instancePath);
         instanceName = strdup(_instanceName);
         deviceName = strdup(_deviceName);
         prefix = strdup(_prefix);
@@ -87,9 +760,27 @@ struct Ioc {
         childStderr.setName("stderr");
         childStderr.clear();
         open = false;
+        memset(&dirMtime, 0, sizeof(dirMtime));
+        memset(&cmdMtime, 0, sizeof(cmdMtime));
+        seen = false;
+        stale = false;
+        macrosComplete = false;
+        engine = NULL;
+        index = NULL;
+        prefixConflict = false;
+        root = NULL;
+        dev = 0;
+        ino = 0;
+        probing = false;
+        nextProbe = 0.0;
+        sequence = 0;
+        childStdout.nextSequence = &sequence;
+        childStderr.nextSequence = &sequence;
+        combined = false;
     }
     ~Ioc() {
         if (stagePath) { free(stagePath); }
+        if (instancePath) { free(instancePath); }
         if (instanceName) { free(instanceName); }
         if (deviceName) { free(deviceName); }
         if (prefix) { free(prefix); }
@@ -97,32 +788,493 @@ struct Ioc {
     bool isStarted(void) {
         return started;
     }
+    bool update(const char * _deviceName, const char * _prefix);
     int start();
     int stop();
+    bool resolve(void);
     int sendCommand(const char * _command);
     int recvResponse(void);
+    void sendProbe(void);
+    void updateProbes(double _now, LatencyStats & _mode);
+    size_t errors(void) {
+        return childStdout.errors + childStderr.errors;
+    }
+    size_t warnings(void) {
+        return childStdout.warnings + childStderr.warnings;
+    }
+    // stream with the last error line, NULL if none
+    ChildData * lastError(void) {
+        if (! childStdout.lastErrorMono && ! childStderr.lastErrorMono) {
+            return NULL;
+        }
+        return (childStderr.lastErrorMono > childStdout.lastErrorMono) ? &childStderr : &childStdout;
+    }
+    void drawCombined(void);
     void draw(void);
     void show(bool * _open);
 };
 
+// a directory of the IOC tree we keep an eye on, see IocList::listDir() for levels
+struct IocWatch {
+    int wd;
+    int level;
+    char * path;
+    // used only when polling
+    struct timespec mtime;
+    struct timespec cmdMtime;
+
+    IocWatch(const char * _path, int _level) {
+        wd = -1;
+        level = _level;
+        path = strdup(_path);
+        memset(&mtime, 0, sizeof(mtime));
+        memset(&cmdMtime, 0, sizeof(cmdMtime));
+    }
+    ~IocWatch() {
+        if (path) { free(path); }
+    }
+};
+
+// keeps track of changes in the IOC tree with inotify; falls back to
+// periodic mtime polling where inotify does not see remote changes (NFS, ..)
+// or runs out of watches
+struct IocWatcher {
+    int fd;
+    bool active;
+    bool polling;
+    double pollPeriod;
+    double lastPoll;
+    std::vector<IocWatch *> watches;
+    // the same watches by folder, and by watch descriptor
+    std::unordered_map<std::string, IocWatch *> byPath;
+    std::unordered_map<int, IocWatch *> byWd;
+
+    IocWatcher() {
+        fd = -1;
+        active = false;
+        polling = false;
+        pollPeriod = 2.0;
+        lastPoll = 0.0;
+    }
+    ~IocWatcher() {
+        stop();
+    }
+    bool start(bool _polling);
+    void stop(void);
+    IocWatch * add(const char * _path, int _level);
+    IocWatch * add(const char * _path, int _level, const struct timespec & _mtime, const struct timespec & _cmdMtime);
+    void remove(const char * _path);
+    void remove(const std::unordered_set<std::string> & _paths);
+    void forget(IocWatch * _watch);
+    IocWatch * find(int _wd) {
+        auto it = byWd.find(_wd);
+        return (it != byWd.end()) ? it->second : NULL;
+    }
+    IocWatch * find(const char * _path) {
+        auto it = byPath.find(_path);
+        return (it != byPath.end()) ? it->second : NULL;
+    }
+    size_t count() {
+        return watches.size();
+    }
+};
+
+// a folder found by the background scan, see IocList::listDir() for levels
+struct IocScanEntry {
+    char * path;
+    int level;
+    bool hasCmd;
+    struct timespec mtime;
+    struct timespec cmdMtime;
+    dev_t dev;
+    ino_t ino;
+    // resolved instance macros (level 3 with instance.cmd)
+    MacroTable * macros;
+};
+
+// folders walked, by (dev, ino); guards against symlink cycles
+typedef std::set<std::pair<dev_t, ino_t>> IocVisited;
+
+// walks an IOC root in a background thread with up to maxThreads workers,
+// one stage at a time per worker, and resolves the instance macros; the IOC
+// list is updated from the results in the main thread
+// the thread is detached and the scan is freed by whoever lets go of it
+// last, a scan stuck on a dead mount never blocks the UI
+struct IocScan {
+    char topPath[512];
+    int maxThreads;
+    bool network;
+    // stage folders, split among the workers
+    std::vector<char *> stages;
+    std::vector<IocScanEntry> entries;
+    // memo of the root, handed over for the duration of the scan
+    MacroEngine engine;
+    std::atomic<bool> done;
+    std::atomic<bool> cancel;
+    std::atomic<int> refs;
+    double startTime;
+    double endTime;
+    // stat() like calls made, folders reached more than once
+    std::atomic<size_t> stats;
+    std::atomic<size_t> revisits;
+    // folders that are there but could not be listed
+    std::atomic<size_t> unreadable;
+    // threads that may still be started, by stage workers and lookups
+    // alike; at most maxThreads run at any time
+    std::atomic<int> spare;
+
+    IocScan(const char * _topPath, int _maxThreads, MacroEngine & _engine) {
+        strncpy(topPath, _topPath, sizeof(topPath) - 1);
+        topPath[sizeof(topPath) - 1] = '\0';
+        maxThreads = (_maxThreads > 0) ? _maxThreads : 1;
+        engine.swap(_engine);
+        network = false;
+        done = false;
+        cancel = false;
+        startTime = launcherTime();
+        endTime = 0.0;
+        stats = 0;
+        revisits = 0;
+        unreadable = 0;
+        spare = 0;
+        // one for the thread, one for the owner
+        refs = 2;
+        std::thread(&IocScan::run, this).detach();
+    }
+    ~IocScan() {
+        for (size_t n = 0; n < stages.size(); n++) {
+            free(stages[n]);
+        }
+        for (size_t n = 0; n < entries.size(); n++) {
+            free(entries[n].path);
+            if (entries[n].macros) {
+                delete entries[n].macros;
+            }
+        }
+    }
+    void release(void) {
+        cancel = true;
+        if (--refs == 0) {
+            delete this;
+        }
+    }
+    void run(void);
+    void walk(const char * _name, int _level, std::vector<IocScanEntry> & _entries, IocVisited & _visited);
+    void merge(std::vector<IocScanEntry> & _entries, IocVisited & _visited);
+    void resolve(void);
+};
+
+// how a root is kept up to date
+enum {
+    ROOT_AUTO = 0,      // watch local trees, periodic walk on network mounts
+    ROOT_WATCH,         // inotify, mtime polling where inotify can not be used
+    ROOT_PERIODIC,      // periodic walk in the background
+};
+
+// a folder holding stages, see IocList::listDir()
+struct IocRoot {
+    char path[512];
+    int strategy;
+    double scanPeriod;
+    int maxThreads;
+    // detected by the last scan
+    bool network;
+    IocWatcher watcher;
+    IocScan * scan;
+    MacroEngine engine;
+    double lastScan;
+    double scanTime;
+    size_t scanStats;
+    size_t iocs;
+
+    IocRoot(const char * _path, int _strategy, double _scanPeriod, int _maxThreads) {
+        strncpy(path, _path, sizeof(path) - 1);
+        path[sizeof(path) - 1] = '\0';
+        // trailing slashes would end up in instance paths
+        for (size_t n = strlen(path); n > 1 && path[n - 1] == '/'; n--) {
+            path[n - 1] = '\0';
+        }
+        strategy = _strategy;
+        scanPeriod = _scanPeriod;
+        maxThreads = _maxThreads;
+        network = false;
+        scan = NULL;
+        lastScan = 0.0;
+        scanTime = 0.0;
+        scanStats = 0;
+        iocs = 0;
+    }
+    ~IocRoot() {
+        if (scan) {
+            scan->release();
+        }
+    }
+    bool periodic(void) {
+        return strategy == ROOT_PERIODIC || (strategy == ROOT_AUTO && network);
+    }
+};
+
+// paces the main loop: instead of rendering at vsync rate forever, sleep
+// until there is input, IOC output, an inotify event or a timer is due
+struct LauncherLoop {
+    bool idle;
+    // 0 for no limit
+    int maxFps;
+    // provided by main(), glfwPostEmptyEvent() and friends; wake must be
+    // safe to call from any thread
+    void (*wake)(void);
+    void (*waitEvents)(double);
+    void (*pollEvents)(void);
+    // frames to render before going idle again, lets imgui settle
+    int settleFrames;
+    double lastFrame;
+    // frames rendered per second over the last minute
+    unsigned frames[60];
+    long frameSecond;
+    // descriptors watched while the main loop sleeps
+    std::thread thread;
+    std::mutex lock;
+    std::condition_variable cond;
+    std::vector<int> fds;
+    bool armed;
+    bool quit;
+    // interrupts poll() when the descriptors change
+    int wakePipe[2];
+
+    LauncherLoop() {
+        idle = true;
+        maxFps = 30;
+        wake = NULL;
+        waitEvents = NULL;
+        pollEvents = NULL;
+        settleFrames = 0;
+        lastFrame = 0.0;
+        memset(frames, 0, sizeof(frames));
+        frameSecond = 0;
+        armed = false;
+        quit = false;
+        wakePipe[0] = wakePipe[1] = -1;
+    }
+    ~LauncherLoop() {
+        stop();
+    }
+    void stop(void);
+    void arm(const std::vector<int> & _fds);
+    void run(void);
+    void expire(double _now);
+    void frame(double _now);
+    unsigned framesPerMinute(void);
+};
+
+// log stream shown in the timeline
+struct TimelineSource {
+    Ioc * ioc;
+    ChildData * data;
+};
+
+// rows scrolled over at most before the merge starts over from a seek
+#define TIMELINE_STEP_ROWS      4096
+
+// output of a set of IOC log streams in the order it was read: a k-way
+// merge by read time, with ties in the order the streams were added. The
+// merged rows are never stored, the merge starts at the first visible row,
+// found by a binary search over time, and runs for as many rows as fit
+struct IocTimeline {
+    bool open;
+    // stay at the end as new lines come in
+    bool follow;
+    bool showStamps;
+    std::vector<TimelineSource> sources;
+    // first visible row and where each stream is at that row
+    size_t top;
+    size_t cursorRow;
+    std::vector<size_t> cursors;
+    // line counts the cursors were found for, the streams may be cleared
+    std::vector<size_t> counts;
+    bool valid;
+
+    IocTimeline() {
+        open = false;
+        follow = true;
+        showStamps = true;
+        top = 0;
+        cursorRow = 0;
+        valid = false;
+    }
+    int find(ChildData * _data) {
+        for (size_t n = 0; n < sources.size(); n++) {
+            if (sources[n].data == _data) {
+                return n;
+            }
+        }
+        return -1;
+    }
+    void add(Ioc * _ioc, ChildData * _data);
+    void remove(ChildData * _data);
+    void remove(Ioc * _ioc);
+    void sync(Ioc * _ioc);
+    size_t before(uint64_t _mono);
+    void seek(size_t _row);
+    void step(std::vector<size_t> & _cursors, size_t _rows);
+    int next(std::vector<size_t> & _cursors);
+    void draw(void);
+};
+
+// columns of the main IOC table
+enum {
+    IOC_COLUMN_ID = 0,
+    IOC_COLUMN_NAME,
+    IOC_COLUMN_PREFIX,
+    IOC_COLUMN_STARTED,
+    IOC_COLUMN_ERRORS,
+    IOC_COLUMN_LAST_ERROR,
+    IOC_COLUMN_OPEN,
+    IOC_COLUMNS
+};
+
+// main IOC table view; rows are kept in display order, sorted again only
+// when the IOCs or the sort column change, and only the visible ones are
+// drawn
+struct IocTable {
+    int sortColumn;
+    bool sortDescending;
+    // indices into IocList::list, in display order
+    std::vector<uint32_t> order;
+    // IocIndex::generation the order was made for
+    unsigned generation;
+    bool sorted;
+    // name, prefix, stage and state filter
+    ImGuiTextFilter filter;
+    // order entries passing the filter, and the query they passed
+    std::vector<uint32_t> rows;
+    char rowsQuery[sizeof(filter.InputBuf)];
+    // lower case "name prefix stage state" of every IOC, by list index
+    std::vector<char> texts;
+    std::vector<uint32_t> textStart;
+    // column positions of the rows, the header follows them
+    float offsets[IOC_COLUMNS];
+
+    IocTable() {
+        sortColumn = IOC_COLUMN_ID;
+        sortDescending = false;
+        generation = 0;
+        sorted = false;
+        rowsQuery[0] = '\0';
+        memset(offsets, 0, sizeof(offsets));
+    }
+    void sortBy(int _column) {
+        if (sortColumn == _column) {
+            // same column, the other way around
+            sortDescending = ! sortDescending;
+            std::reverse(order.begin(), order.end());
+            std::reverse(rows.begin(), rows.end());
+        } else {
+            sortColumn = _column;
+            sortDescending = false;
+            sorted = false;
+        }
+    }
+    void sort(std::vector<Ioc *> & _list);
+    void buildTexts(std::vector<Ioc *> & _list);
+    void filterRows(bool _refine);
+    void update(std::vector<Ioc *> & _list, unsigned _generation);
+};
+
 struct IocList {
     std::vector<Ioc *> list;
-    char topPath[512];
+    std::vector<IocRoot *> roots;
+    // main thread memo, used for single instances that changed
+    MacroEngine engine;
+    IocIndex index;
+    LauncherLoop loop;
+    IocTable table;
+    // log line severities, see loadSeverity()
+    PatternMatcher severity;
+    // reactions to strings in the output, see loadTriggers(); the matcher
+    // values are the trigger index plus one
+    std::vector<Trigger> triggers;
+    PatternMatcher triggerMatcher;
+    bool cacheDirty;
+    // some IOCs are stale, dropped once they stop
+    bool haveStale;
+    // profiler overlay, the zones are recorded while it is shown
+    bool showProfiler;
+    // merged output of the IOCs picked in their windows
+    IocTimeline timeline;
+    // marker line latencies of all the IOCs, per main loop mode
+    std::unordered_map<std::string, LatencyStats> latencyModes;
+    // new root input
+    char newRoot[512];
+    // search box state
+    char searchText[128];
+    std::vector<Ioc *> searchOwners;
+    std::vector<Ioc *> searchMatches;
+    size_t searchTotal;
+    unsigned searchGeneration;
 
     IocList() {
-        topPath[0] = '\0';
+        newRoot[0] = '\0';
+        searchText[0] = '\0';
+        searchTotal = 0;
+        searchGeneration = 0;
+        cacheDirty = false;
+        haveStale = false;
+        showProfiler = false;
         clear();
     }
     ~IocList() {
         clear();
+        for (size_t n = 0; n < roots.size(); n++) {
+            delete roots[n];
+        }
     }
-    size_t populate(void);
     void clear();
-    void listDir(const char * _name, int _level);
-    bool parseInstanceFile(const char *_path, const char * _name);
-    char * parseInstanceLine(char *_line);
+    void listDir(IocRoot * _root, const char * _name, int _level);
+    static bool wantDir(const char * _name, int _level);
+    static const char * splitInstancePath(const char * _path, char * _stagePath, size_t _size);
+    bool parseInstanceFile(IocRoot * _root, const char *_path, const char * _name);
+    Ioc * applyInstance(IocRoot * _root, const char * _path, MacroTable & _macros,
+        const struct timespec & _dirMtime, const struct timespec & _cmdMtime, dev_t _dev, ino_t _ino);
+    size_t update(void);
+    double nextTimer(void);
+    void recvResponses(void);
+    void updateProbes(void);
+    size_t handleEvents(IocRoot * _root);
+    size_t pollChanges(IocRoot * _root);
+    size_t rescanDir(IocRoot * _root, IocWatch * _watch, const struct timespec & _mtime);
+    void startScan(IocRoot * _root);
+    size_t applyScan(IocRoot * _root, IocScan * _scan);
+    IocRoot * addRoot(const char * _path, int _strategy, double _scanPeriod, int _maxThreads);
+    void removeRoot(IocRoot * _root);
+    IocRoot * findRoot(const char * _path);
+    bool loadRoots(void);
+    bool saveRoots(void);
+    bool loadSeverity(void);
+    bool loadTriggers(void);
+    bool saveTriggers(void);
+    void buildTriggers(void);
+    void fireTriggers(Ioc * _ioc);
+    void drawTriggers(void);
+    bool loadCache(void);
+    bool saveCache(void);
+
+    Ioc * findIoc(const char * _instancePath) {
+        return index.findPath(_instancePath);
+    }
+    size_t removeIocs(const char * _path);
+    size_t removeIocs(const std::unordered_set<std::string> & _paths);
+    size_t removeIocs(IocRoot * _root, bool _unseen);
+    bool dropIoc(Ioc * _ioc);
+    size_t dropStale(void);
 
     void addIoc(Ioc * _ioc) {
+        _ioc->engine = &engine;
+        _ioc->index = &index;
+        _ioc->childStdout.matcher = &severity;
+        _ioc->childStderr.matcher = &severity;
+        _ioc->childStdout.triggers = &triggerMatcher;
+        _ioc->childStderr.triggers = &triggerMatcher;
+        index.insert(_ioc);
         list.push_back(_ioc);
     }
     size_t count() {
@@ -138,6 +1290,7 @@ struct IocList {
 
 IocList *launcherInitialize(void);
 void launcherDraw(IocList *_iocs);
+void launcherWait(IocList *_iocs);
 void launcherDestroy(IocList *_iocs);
 
 #endif // LAUNCHER_H
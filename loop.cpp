@@ -0,0 +1,209 @@
+#include "launcher.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <algorithm>
+
+// stop the descriptor watching thread
+void LauncherLoop::stop(void) {
+    if (! thread.joinable()) {
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        quit = true;
+    }
+    cond.notify_one();
+    if (write(wakePipe[1], "q", 1) != 1) {
+        E("write() wake pipe failed %s\n", strerror(errno));
+    }
+    thread.join();
+    close(wakePipe[0]);
+    close(wakePipe[1]);
+    wakePipe[0] = wakePipe[1] = -1;
+}
+
+// watch _fds until one of them is readable (or hung up), then wake up the
+// main loop once; called every time the main loop is about to sleep
+void LauncherLoop::arm(const std::vector<int> & _fds) {
+    if (! wake) {
+        return;
+    }
+    if (! thread.joinable()) {
+        if (pipe2(wakePipe, O_NONBLOCK | O_CLOEXEC) != 0) {
+            E("pipe2() failed %s\n", strerror(errno));
+            wake = NULL;
+            return;
+        }
+        thread = std::thread(&LauncherLoop::run, this);
+    }
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        fds = _fds;
+        armed = true;
+    }
+    cond.notify_one();
+    // poll() might be waiting on the previous descriptors
+    if (write(wakePipe[1], "a", 1) != 1 && errno != EAGAIN) {
+        E("write() wake pipe failed %s\n", strerror(errno));
+    }
+}
+
+void LauncherLoop::run(void) {
+    std::vector<struct pollfd> pfds;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            cond.wait(guard, [this]() { return armed || quit; });
+            if (quit) {
+                break;
+            }
+            pfds.resize(fds.size() + 1);
+            for (size_t n = 0; n < fds.size(); n++) {
+                pfds[n + 1].fd = fds[n];
+                pfds[n + 1].events = POLLIN;
+            }
+        }
+        pfds[0].fd = wakePipe[0];
+        pfds[0].events = POLLIN;
+
+        int ret = poll(pfds.data(), pfds.size(), -1);
+        if (ret == -1) {
+            if (errno != EINTR) {
+                E("poll() failed %s\n", strerror(errno));
+            }
+            continue;
+        }
+        if (pfds[0].revents) {
+            // new descriptors (or quit), drain and start over
+            char buf[64];
+            while (read(wakePipe[0], buf, sizeof(buf)) > 0) {
+            }
+            continue;
+        }
+        // the main loop reads the data and arms us again before sleeping;
+        // until then the descriptors would keep poll() spinning
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            armed = false;
+        }
+        wake();
+    }
+}
+
+// forget the frames older than a minute
+void LauncherLoop::expire(double _now) {
+    long second = (long)_now;
+    if (second - frameSecond >= 60) {
+        memset(frames, 0, sizeof(frames));
+    } else {
+        for (long s = frameSecond + 1; s <= second; s++) {
+            frames[s % 60] = 0;
+        }
+    }
+    frameSecond = second;
+}
+
+// account a rendered frame
+void LauncherLoop::frame(double _now) {
+    expire(_now);
+    frames[frameSecond % 60]++;
+    lastFrame = _now;
+}
+
+unsigned LauncherLoop::framesPerMinute(void) {
+    expire(launcherTime());
+    unsigned total = 0;
+    for (int n = 0; n < 60; n++) {
+        total += frames[n];
+    }
+    return total;
+}
+
+// time when the next timer in the IOC roots is due
+double IocList::nextTimer(void) {
+    double now = launcherTime();
+    // nothing to do, but keep the clock-like readouts roughly current
+    double next = now + 10.0;
+    for (size_t n = 0; n < roots.size(); n++) {
+        IocRoot * root = roots[n];
+        if (root->scan) {
+            // scans do not tell when they are done, and show progress
+            next = std::min(next, now + 0.25);
+        } else if (root->periodic() && root->lastScan > 0.0) {
+            next = std::min(next, root->lastScan + root->scanPeriod);
+        }
+        if (root->watcher.active && root->watcher.polling) {
+            next = std::min(next, root->watcher.lastPoll + root->watcher.pollPeriod);
+        }
+    }
+    // output latency probes, and giving up on the ones never shown
+    for (size_t n = 0; n < list.size(); n++) {
+        Ioc * ioc = list[n];
+        if (ioc->probing && ioc->started) {
+            next = std::min(next, ioc->nextProbe);
+        }
+        if (ioc->childStdout.probes.size()) {
+            next = std::min(next, ioc->childStdout.probes[0].ingested + LATENCY_TIMEOUT);
+        }
+        if (ioc->childStderr.probes.size()) {
+            next = std::min(next, ioc->childStderr.probes[0].ingested + LATENCY_TIMEOUT);
+        }
+    }
+    return next;
+}
+
+// called by main() before every frame: limits the frame rate and, when
+// nothing is going on, sleeps until something is
+void launcherWait(IocList * _iocs) {
+    IM_ASSERT(_iocs != NULL);
+    LauncherLoop & loop = _iocs->loop;
+
+    double now = launcherTime();
+    if (loop.maxFps > 0) {
+        double left = loop.lastFrame + 1.0 / loop.maxFps - now;
+        if (left > 0.0) {
+            // input piles up in the meantime and is handled in one frame
+            usleep(left * 1e6);
+        }
+    }
+
+    // imgui needs a frame or two to react to input, and keeps going while
+    // a widget is being used (dragged, edited, ..)
+    if (ImGui::GetCurrentContext() && (ImGui::IsAnyItemActive() || ImGui::IsMouseDown(0))) {
+        loop.settleFrames = 2;
+    }
+    if (! loop.idle || ! loop.waitEvents || loop.settleFrames > 0) {
+        if (loop.settleFrames > 0) {
+            loop.settleFrames--;
+        }
+        if (loop.pollEvents) {
+            loop.pollEvents();
+        }
+    } else {
+        std::vector<int> fds;
+        for (size_t n = 0; n < _iocs->count(); n++) {
+            Ioc * ioc = _iocs->ioc(n);
+            if (ioc->started) {
+                fds.push_back(ioc->childStdout.fd);
+                fds.push_back(ioc->childStderr.fd);
+            }
+        }
+        for (size_t n = 0; n < _iocs->roots.size(); n++) {
+            if (_iocs->roots[n]->watcher.fd != -1) {
+                fds.push_back(_iocs->roots[n]->watcher.fd);
+            }
+        }
+        loop.arm(fds);
+        double timeout = _iocs->nextTimer() - launcherTime();
+        if (timeout > 0.0) {
+            loop.waitEvents(timeout);
+        } else if (loop.pollEvents) {
+            loop.pollEvents();
+        }
+        loop.settleFrames = 1;
+    }
+    loop.frame(launcherTime());
+}
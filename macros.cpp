@@ -0,0 +1,445 @@
+#include "launcher.h"
+#include "macros.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+MappedFile::MappedFile(const char * _path) {
+    data = NULL;
+    size = 0;
+    memset(&mtime, 0, sizeof(mtime));
+    error = 0;
+
+    int fd = open(_path, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        error = errno;
+        return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        error = errno;
+        close(fd);
+        return;
+    }
+    mtime = st.st_mtim;
+    size = st.st_size;
+    if (size) {
+        void * map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (map == MAP_FAILED) {
+            error = errno;
+            size = 0;
+        } else {
+            data = (const char *)map;
+        }
+    }
+    close(fd);
+}
+
+MappedFile::~MappedFile() {
+    if (data) {
+        munmap((void *)data, size);
+    }
+}
+
+static inline bool isBlank(char _c) {
+    return _c == ' ' || _c == '\t' || _c == '\r';
+}
+
+// iocsh argument: "quoted" (may contain anything but a newline) or bare word
+static bool scanArg(const char *& _pos, const char * _end, const char *& _arg, size_t & _len) {
+    const char * p = _pos;
+    while (p < _end && (isBlank(*p) || *p == ',')) {
+        p++;
+    }
+    if (p == _end || *p == '\n' || *p == ')') {
+        _pos = p;
+        return false;
+    }
+    if (*p == '"') {
+        const char * s = ++p;
+        while (p < _end && *p != '"' && *p != '\n') {
+            if (*p == '\\' && p + 1 < _end && p[1] != '\n') {
+                p++;
+            }
+            p++;
+        }
+        _arg = s;
+        _len = p - s;
+        if (p < _end && *p == '"') {
+            p++;
+        }
+    } else {
+        const char * s = p;
+        while (p < _end && ! isBlank(*p) && *p != ',' && *p != '(' && *p != ')' && *p != '\n') {
+            // iocsh expands macros before splitting the line, $(X) is one word
+            if (*p == '$' && p + 1 < _end && (p[1] == '(' || p[1] == '{')) {
+                int nest = 0;
+                for (p++; p < _end && *p != '\n'; p++) {
+                    if (*p == '(' || *p == '{') {
+                        nest++;
+                    } else if ((*p == ')' || *p == '}') && --nest == 0) {
+                        break;
+                    }
+                }
+                if (p == _end || *p == '\n') {
+                    break;
+                }
+            }
+            p++;
+        }
+        _arg = s;
+        _len = p - s;
+    }
+    _pos = p;
+    return true;
+}
+
+bool CmdScanner::next(void) {
+    static const char envSet[] = "epicsEnvSet";
+    const size_t envSetLen = sizeof(envSet) - 1;
+
+    kind = CMD_NONE;
+    while (pos < end) {
+        const char * p = pos;
+        const char * eol = (const char *)memchr(p, '\n', end - p);
+        if (! eol) {
+            eol = end;
+        }
+        // next statement starts on the next line, whatever happens below
+        pos = (eol < end) ? eol + 1 : end;
+
+        while (p < eol && isBlank(*p)) {
+            p++;
+        }
+        if (p < eol && *p == '<') {
+            // < file
+            p++;
+            if (! scanArg(p, eol, value, valueLen) || valueLen == 0) {
+                continue;
+            }
+            name = value;
+            nameLen = 0;
+            kind = CMD_INCLUDE;
+            return true;
+        }
+        if ((size_t)(eol - p) <= envSetLen || memcmp(p, envSet, envSetLen) != 0) {
+            // comment, empty line or other command
+            continue;
+        }
+        p += envSetLen;
+        if (! isBlank(*p) && *p != '(') {
+            // epicsEnvSetSomething
+            continue;
+        }
+        while (p < eol && isBlank(*p)) {
+            p++;
+        }
+        if (p < eol && *p == '(') {
+            p++;
+        }
+        if (! scanArg(p, eol, name, nameLen) || nameLen == 0) {
+            continue;
+        }
+        if (! scanArg(p, eol, value, valueLen)) {
+            // epicsEnvSet(NAME) sets an empty value
+            value = p;
+            valueLen = 0;
+        }
+        kind = CMD_ENVSET;
+        return true;
+    }
+    return false;
+}
+
+static inline uint32_t hashString(const char * _str, size_t _len) {
+    // FNV-1a
+    uint32_t h = 2166136261u;
+    for (size_t n = 0; n < _len; n++) {
+        h ^= (unsigned char)_str[n];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// slot of the string, or the free slot it would go to; the table is
+// never full
+size_t MacroTable::lookup(const char * _str, size_t _len) {
+    size_t mask = slots.size() - 1;
+    size_t i = hashString(_str, _len) & mask;
+    while (slots[i].offset) {
+        const char * s = &strings[slots[i].offset];
+        if (strncmp(s, _str, _len) == 0 && s[_len] == '\0') {
+            break;
+        }
+        i = (i + 1) & mask;
+    }
+    return i;
+}
+
+// store the string once, return its slot; the slots move when the table
+// grows
+size_t MacroTable::insert(const char * _str, size_t _len) {
+    if (slots.size()) {
+        size_t i = lookup(_str, _len);
+        if (slots[i].offset) {
+            return i;
+        }
+    }
+
+    // keep the load factor below 1/2
+    if ((used + 1) * 2 > slots.size()) {
+        std::vector<MacroSlot> old;
+        old.swap(slots);
+        slots.assign(old.size() ? old.size() * 2 : 64, MacroSlot{0, 0});
+        size_t mask = slots.size() - 1;
+        for (size_t n = 0; n < old.size(); n++) {
+            if (old[n].offset) {
+                const char * s = &strings[old[n].offset];
+                size_t i = hashString(s, strlen(s)) & mask;
+                while (slots[i].offset) {
+                    i = (i + 1) & mask;
+                }
+                slots[i] = old[n];
+            }
+        }
+    }
+
+    size_t i = lookup(_str, _len);
+    slots[i].offset = strings.size();
+    slots[i].name = 0;
+    strings.insert(strings.end(), _str, _str + _len);
+    strings.push_back('\0');
+    used++;
+    return i;
+}
+
+// later definitions override the earlier ones, like in iocsh
+void MacroTable::set(const char * _name, size_t _nameLen, const char * _value, size_t _valueLen) {
+    uint32_t value = intern(_value, _valueLen);
+    // the name last, inserting the value may have moved its slot
+    MacroSlot & slot = slots[insert(_name, _nameLen)];
+    if (slot.name) {
+        values[slot.name - 1] = value;
+        return;
+    }
+    names.push_back(slot.offset);
+    values.push_back(value);
+    slot.name = names.size();
+}
+
+const char * MacroTable::get(const char * _name) {
+    if (slots.empty()) {
+        return NULL;
+    }
+    MacroSlot & slot = slots[lookup(_name, strlen(_name))];
+    return slot.name ? &strings[values[slot.name - 1]] : NULL;
+}
+
+// IOC prefix is LOCATION:DEVICE_NAME:, returns the device name (CAMERA_NAME)
+// or NULL if any of them is not defined
+const char * instancePrefix(MacroTable & _macros, char * _prefix, size_t _size) {
+    const char * loc = _macros.get(INSTANCE_LOCATION);
+    const char * dev = _macros.get(INSTANCE_DEVICE_NAME);
+    const char * deviceName = _macros.get(INSTANCE_CAMERA_NAME);
+    if ((loc == NULL) || (dev == NULL) || (deviceName == NULL)) {
+        return NULL;
+    }
+    D("found LOCATION: '%s', DEVICE_NAME: '%s', CAMERA_NAME: '%s'\n", loc, dev, deviceName);
+    snprintf(_prefix, _size, "%s:%s:", loc, dev);
+    return deviceName;
+}
+
+// scan the file once and keep its statements until it changes
+MacroFile * MacroEngine::load(const char * _path) {
+    std::string key(_path);
+    auto it = files.find(key);
+    if (it != files.end()) {
+        MacroFile * file = it->second;
+        if (file->checked == generation) {
+            hits++;
+            return file;
+        }
+        struct stat st;
+        bool missing = stat(_path, &st) != 0;
+        if (missing == file->missing && (missing || sameMtime(st.st_mtim, file->mtime))) {
+            file->checked = generation;
+            hits++;
+            return file;
+        }
+        delete file;
+        files.erase(it);
+    }
+
+    misses++;
+    MacroFile * file = new MacroFile();
+    file->checked = generation;
+    MappedFile mapped(_path);
+    file->missing = ! mapped.valid();
+    file->mtime = mapped.mtime;
+    CmdScanner scanner(mapped.data, mapped.size);
+    while (scanner.next()) {
+        MacroStatement statement;
+        statement.kind = scanner.kind;
+        statement.name = file->text.size();
+        statement.nameLen = scanner.nameLen;
+        file->text.insert(file->text.end(), scanner.name, scanner.name + scanner.nameLen);
+        statement.value = file->text.size();
+        statement.valueLen = scanner.valueLen;
+        file->text.insert(file->text.end(), scanner.value, scanner.value + scanner.valueLen);
+        file->statements.push_back(statement);
+    }
+    files[key] = file;
+    D("scanned %s, %zu statements\n", _path, file->statements.size());
+    return file;
+}
+
+// file is known to have changed, scan it again on next use
+void MacroEngine::invalidate(const char * _path) {
+    auto it = files.find(_path);
+    if (it != files.end()) {
+        delete it->second;
+        files.erase(it);
+    }
+}
+
+// macLib style expansion; values in _macros are already expanded, the
+// process environment is used for names not defined by the scripts
+void MacroEngine::expand(const char * _str, size_t _len, MacroTable & _macros, std::vector<char> & _out, int _depth) {
+    size_t i = 0;
+    while (i < _len) {
+        char c = _str[i];
+        if (c == '\\' && i + 1 < _len) {
+            _out.push_back(_str[i + 1]);
+            i += 2;
+            continue;
+        }
+        if (c != '$' || i + 1 >= _len || (_str[i + 1] != '(' && _str[i + 1] != '{')) {
+            _out.push_back(c);
+            i++;
+            continue;
+        }
+
+        // find the matching bracket, references can be nested
+        size_t start = i + 2;
+        size_t j = start;
+        size_t eq = 0;
+        int nest = 0;
+        for (; j < _len; j++) {
+            if (_str[j] == '(' || _str[j] == '{') {
+                nest++;
+            } else if (_str[j] == ')' || _str[j] == '}') {
+                if (nest == 0) {
+                    break;
+                }
+                nest--;
+            } else if (_str[j] == '=' && nest == 0 && eq == 0) {
+                eq = j;
+            }
+        }
+        if (j == _len || _depth > 10) {
+            // unterminated or runaway; keep the text as is
+            _out.insert(_out.end(), _str + i, _str + _len);
+            return;
+        }
+
+        size_t nameEnd = eq ? eq : j;
+        std::vector<char> name;
+        expand(_str + start, nameEnd - start, _macros, name, _depth + 1);
+        name.push_back('\0');
+        const char * value = _macros.get(name.data());
+        if (! value) {
+            value = getenv(name.data());
+        }
+        if (value) {
+            _out.insert(_out.end(), value, value + strlen(value));
+        } else if (eq) {
+            expand(_str + eq + 1, j - eq - 1, _macros, _out, _depth + 1);
+        } else {
+            // undefined, left in place like macLib does
+            _out.insert(_out.end(), _str + i, _str + j + 1);
+        }
+        i = j + 1;
+    }
+}
+
+void MacroEngine::evaluate(const char * _path, const char * _cwd, MacroTable & _macros, int _depth) {
+    if (_depth > 16) {
+        E("includes nested too deep at %s\n", _path);
+        return;
+    }
+    MacroFile * file = load(_path);
+    std::vector<char> name;
+    std::vector<char> value;
+    for (size_t n = 0; n < file->statements.size(); n++) {
+        // file might be reloaded by a nested include of itself
+        const MacroStatement statement = file->statements[n];
+        const char * text = file->text.data();
+        value.clear();
+        expand(text + statement.value, statement.valueLen, _macros, value, 0);
+        if (statement.kind == CMD_ENVSET) {
+            name.clear();
+            expand(text + statement.name, statement.nameLen, _macros, name, 0);
+            _macros.set(name.data(), name.size(), value.data(), value.size());
+        } else if (statement.kind == CMD_INCLUDE) {
+            value.push_back('\0');
+            char include[1024];
+            if (value[0] == '/') {
+                snprintf(include, sizeof(include), "%s", value.data());
+            } else {
+                snprintf(include, sizeof(include), "%s/%s", _cwd, value.data());
+            }
+            evaluate(include, _cwd, _macros, _depth + 1);
+            file = load(_path);
+        }
+    }
+}
+
+// resolve the macros the IOC in _instancePath starts with; st.cmd is what
+// start_ioc.sh runs, when it is not there (yet) we go with instance.cmd
+bool MacroEngine::resolve(const char * _stagePath, const char * _instancePath, MacroTable & _macros, struct timespec * _cmdMtime) {
+    char path[1024];
+    _macros.clear();
+
+    // the ones start_ioc.sh puts in envVars
+    static const struct {
+        const char * name;
+        const char * fmt;
+    } seeds[] = {
+        { "TOP_DIR", "%s" },
+        { "BIN_DIR", "%s/bin" },
+        { "DB_DIR", "%s/db" },
+        { "DBD_DIR", "%s/dbd" },
+        { "EPICS_DB_INCLUDE_PATH", "%s/db" },
+    };
+    for (size_t n = 0; n < sizeof(seeds) / sizeof(seeds[0]); n++) {
+        snprintf(path, sizeof(path), seeds[n].fmt, _stagePath);
+        _macros.set(seeds[n].name, strlen(seeds[n].name), path, strlen(path));
+    }
+    snprintf(path, sizeof(path), "%s/autosave", _instancePath);
+    _macros.set("AUTOSAVE_DIR", 12, path, strlen(path));
+    snprintf(path, sizeof(path), "%s/log", _instancePath);
+    _macros.set("LOG_DIR", 7, path, strlen(path));
+    _macros.set("IOC_DIR", 7, _instancePath, strlen(_instancePath));
+
+    snprintf(path, sizeof(path), "%s/instance.cmd", _instancePath);
+    MacroFile * instance = load(path);
+    if (instance->missing) {
+        return false;
+    }
+    if (_cmdMtime) {
+        *_cmdMtime = instance->mtime;
+    }
+
+    snprintf(path, sizeof(path), "%s/st.cmd", _instancePath);
+    if (! load(path)->missing) {
+        evaluate(path, _instancePath, _macros, 0);
+    }
+    // st.cmd that does not include instance.cmd
+    if (! _macros.get(INSTANCE_LOCATION) || ! _macros.get(INSTANCE_DEVICE_NAME) || ! _macros.get(INSTANCE_CAMERA_NAME)) {
+        snprintf(path, sizeof(path), "%s/instance.cmd", _instancePath);
+        evaluate(path, _instancePath, _macros, 0);
+    }
+    return true;
+}
@@ -0,0 +1,176 @@
+#ifndef MACROS_H
+#define MACROS_H
+
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <vector>
+#include <string>
+#include <unordered_map>
+
+// read-only view of a whole file, mapped into memory
+struct MappedFile {
+    const char * data;
+    size_t size;
+    struct timespec mtime;
+    int error;
+
+    MappedFile(const char * _path);
+    ~MappedFile();
+    bool valid(void) {
+        return error == 0;
+    }
+};
+
+// iocsh statements recognized by CmdScanner
+enum {
+    CMD_NONE = 0,
+    CMD_ENVSET,         // epicsEnvSet("NAME", "VALUE")
+    CMD_INCLUDE,        // < file, path is in value
+};
+
+// single pass, zero allocation scanner over the iocsh script text; after
+// next() returns true, name/value point into the scanned text (raw, with
+// macro references and escapes as written)
+struct CmdScanner {
+    const char * pos;
+    const char * end;
+    int kind;
+    const char * name;
+    size_t nameLen;
+    const char * value;
+    size_t valueLen;
+
+    CmdScanner(const char * _data, size_t _size) {
+        pos = _data;
+        end = _data + _size;
+        kind = CMD_NONE;
+        name = value = NULL;
+        nameLen = valueLen = 0;
+    }
+    bool next(void);
+    bool nameIs(const char * _name) {
+        return strlen(_name) == nameLen && memcmp(_name, name, nameLen) == 0;
+    }
+};
+
+// name/value pairs with all the strings interned in a single buffer
+struct MacroSlot {
+    // offset of the string in strings, 0 for a free slot
+    uint32_t offset;
+    // index in names plus 1 when the string is a macro name, else 0
+    uint32_t name;
+};
+
+struct MacroTable {
+    std::vector<char> strings;
+    std::vector<MacroSlot> slots;
+    size_t used;
+    std::vector<uint32_t> names;
+    std::vector<uint32_t> values;
+
+    MacroTable() {
+        clear();
+    }
+    void clear(void) {
+        strings.clear();
+        slots.clear();
+        used = 0;
+        names.clear();
+        values.clear();
+        // offset 0 marks a free slot, no string starts there
+        strings.push_back('\0');
+    }
+    size_t lookup(const char * _str, size_t _len);
+    size_t insert(const char * _str, size_t _len);
+    uint32_t intern(const char * _str, size_t _len) {
+        return slots[insert(_str, _len)].offset;
+    }
+    void set(const char * _name, size_t _nameLen, const char * _value, size_t _valueLen);
+    const char * get(const char * _name);
+    size_t count(void) {
+        return names.size();
+    }
+    const char * name(size_t _n) {
+        return &strings[names[_n]];
+    }
+    const char * value(size_t _n) {
+        return &strings[values[_n]];
+    }
+    void swap(MacroTable & _other) {
+        strings.swap(_other.strings);
+        slots.swap(_other.slots);
+        size_t tmp = used;
+        used = _other.used;
+        _other.used = tmp;
+        names.swap(_other.names);
+        values.swap(_other.values);
+    }
+};
+
+// macros an instance.cmd must define for the IOC to be listed
+#define INSTANCE_LOCATION       "LOCATION"
+#define INSTANCE_DEVICE_NAME    "DEVICE_NAME"
+#define INSTANCE_CAMERA_NAME    "CAMERA_NAME"
+
+const char * instancePrefix(MacroTable & _macros, char * _prefix, size_t _size);
+
+// statement of a memoized script, name and value are offsets into MacroFile::text
+struct MacroStatement {
+    int kind;
+    uint32_t name;
+    uint32_t nameLen;
+    uint32_t value;
+    uint32_t valueLen;
+};
+
+// scanned iocsh script, shared by all the IOCs that include it
+struct MacroFile {
+    struct timespec mtime;
+    unsigned checked;
+    bool missing;
+    std::vector<char> text;
+    std::vector<MacroStatement> statements;
+};
+
+// evaluates the epicsEnvSet() and '< file' statements of an IOC startup
+// script the way iocsh would: follows includes relative to the instance
+// folder and expands $(NAME), ${NAME} and $(NAME=default) references
+struct MacroEngine {
+    std::unordered_map<std::string, MacroFile *> files;
+    // files are checked for changes once per generation
+    unsigned generation;
+    size_t hits;
+    size_t misses;
+
+    MacroEngine() {
+        generation = 1;
+        hits = 0;
+        misses = 0;
+    }
+    ~MacroEngine() {
+        clear();
+    }
+    void clear(void) {
+        for (auto it = files.begin(); it != files.end(); ++it) {
+            delete it->second;
+        }
+        files.clear();
+    }
+    void nextGeneration(void) {
+        generation++;
+    }
+    void swap(MacroEngine & _other) {
+        files.swap(_other.files);
+        unsigned tmp = generation;
+        generation = _other.generation;
+        _other.generation = tmp;
+    }
+    MacroFile * load(const char * _path);
+    void invalidate(const char * _path);
+    bool resolve(const char * _stagePath, const char * _instancePath, MacroTable & _macros, struct timespec * _cmdMtime);
+    void evaluate(const char * _path, const char * _cwd, MacroTable & _macros, int _depth);
+    void expand(const char * _str, size_t _len, MacroTable & _macros, std::vector<char> & _out, int _depth);
+};
+
+#endif // MACROS_H
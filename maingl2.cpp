@@ -78,6 +78,11 @@ int main(int, char**)
 
     // initialize our app
     IocList * iocs = launcherInitialize();
+    profilerThreadName("main");
+    // let the launcher sleep between frames and wake us up on IOC output
+    iocs->loop.wake = glfwPostEmptyEvent;
+    iocs->loop.waitEvents = glfwWaitEventsTimeout;
+    iocs->loop.pollEvents = glfwPollEvents;
 
     // Main loop
     while (!glfwWindowShouldClose(window))
@@ -87,12 +92,20 @@ int main(int, char**)
         // - When io.WantCaptureMouse is true, do not dispatch mouse input data to your main application.
         // - When io.WantCaptureKeyboard is true, do not dispatch keyboard input data to your main application.
         // Generally you may always pass all inputs to dear imgui, and hide them from your application based on those two flags.
-        glfwPollEvents();
+        // The launcher polls, or waits for events when there is nothing to do.
+        profilerFrame();
+        {
+            PROFILE_ZONE("launcherWait");
+            launcherWait(iocs);
+        }
 
         // Start the Dear ImGui frame
-        ImGui_ImplOpenGL2_NewFrame();
-        ImGui_ImplGlfw_NewFrame();
-        ImGui::NewFrame();
+        {
+            PROFILE_ZONE("NewFrame");
+            ImGui_ImplOpenGL2_NewFrame();
+            ImGui_ImplGlfw_NewFrame();
+            ImGui::NewFrame();
+        }
 
         // 1. Show the big demo window (Most of the sample code is in ImGui::ShowDemoWindow()! You can browse its code to learn more about Dear ImGui!).
         if (show_demo_window)
@@ -137,7 +150,10 @@ int main(int, char**)
         }
 
         // Rendering
-        ImGui::Render();
+        {
+            PROFILE_ZONE("ImGui::Render");
+            ImGui::Render();
+        }
         int display_w, display_h;
         glfwGetFramebufferSize(window, &display_w, &display_h);
         glViewport(0, 0, display_w, display_h);
@@ -149,11 +165,21 @@ int main(int, char**)
         //GLint last_program;
         //glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
         //glUseProgram(0);
-        ImGui_ImplOpenGL2_RenderDrawData(ImGui::GetDrawData());
+        {
+            PROFILE_ZONE("RenderDrawData");
+            ImDrawData * drawData = ImGui::GetDrawData();
+            // what goes to the GPU this frame
+            PROFILE_COUNTER("vertices", drawData->TotalVtxCount);
+            PROFILE_COUNTER("upload bytes", drawData->TotalVtxCount * sizeof(ImDrawVert) + drawData->TotalIdxCount * sizeof(ImDrawIdx));
+            ImGui_ImplOpenGL2_RenderDrawData(drawData);
+        }
         //glUseProgram(last_program);
 
         glfwMakeContextCurrent(window);
-        glfwSwapBuffers(window);
+        {
+            PROFILE_ZONE("SwapBuffers");
+            glfwSwapBuffers(window);
+        }
     }
 
     // destroy our app
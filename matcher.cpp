@@ -0,0 +1,91 @@
+#include "launcher.h"
+
+#include <stdio.h>
+
+void PatternMatcher::add(const char * _pattern, int _value) {
+    std::string pattern;
+    for (const char * p = _pattern; *p; p++) {
+        pattern += (*p >= 'A' && *p <= 'Z') ? *p - 'A' + 'a' : *p;
+    }
+    if (pattern.size() && _value > 0) {
+        patterns.push_back(std::make_pair(pattern, _value));
+    }
+}
+
+// a trie of the patterns, then the failure links are followed once here
+// instead of for every byte of every line
+void PatternMatcher::build(void) {
+    memset(classes, 0, sizeof(classes));
+    classCount = 1;
+    for (size_t n = 0; n < patterns.size(); n++) {
+        for (size_t i = 0; i < patterns[n].first.size(); i++) {
+            unsigned char c = patterns[n].first[i];
+            if (! classes[c]) {
+                classes[c] = classCount++;
+            }
+        }
+    }
+    for (int c = 'a'; c <= 'z'; c++) {
+        classes[c - 'a' + 'A'] = classes[c];
+    }
+
+    next.assign(classCount, -1);
+    std::vector<std::vector<int>> values(1);
+    for (size_t n = 0; n < patterns.size(); n++) {
+        int state = 0;
+        for (size_t i = 0; i < patterns[n].first.size(); i++) {
+            int & to = next[state * classCount + classes[(unsigned char)patterns[n].first[i]]];
+            if (to < 0) {
+                to = values.size();
+                values.push_back(std::vector<int>());
+                next.resize(next.size() + classCount, -1);
+            }
+            state = next[state * classCount + classes[(unsigned char)patterns[n].first[i]]];
+        }
+        values[state].push_back(patterns[n].second);
+    }
+
+    // breadth first, the failure state of a state is always closer to the
+    // root and has all its values by the time they are copied
+    std::vector<int> fail(values.size(), 0);
+    std::vector<int> queue;
+    for (int c = 0; c < classCount; c++) {
+        if (next[c] < 0) {
+            next[c] = 0;
+        } else {
+            queue.push_back(next[c]);
+        }
+    }
+    for (size_t n = 0; n < queue.size(); n++) {
+        int state = queue[n];
+        values[state].insert(values[state].end(), values[fail[state]].begin(), values[fail[state]].end());
+        for (int c = 0; c < classCount; c++) {
+            int & to = next[state * classCount + c];
+            if (to < 0) {
+                to = next[fail[state] * classCount + c];
+            } else {
+                fail[to] = next[fail[state] * classCount + c];
+                queue.push_back(to);
+            }
+        }
+    }
+
+    // states as rows
+    for (size_t n = 0; n < next.size(); n++) {
+        next[n] *= classCount;
+    }
+    output.assign(next.size(), 0);
+    first.assign(values.size() + 1, 0);
+    hits.clear();
+    for (size_t n = 0; n < values.size(); n++) {
+        first[n] = hits.size();
+        int highest = 0;
+        for (size_t i = 0; i < values[n].size(); i++) {
+            hits.push_back(values[n][i]);
+            highest = std::max(highest, values[n][i]);
+        }
+        output[n * classCount] = std::min(highest, 255);
+    }
+    first[values.size()] = hits.size();
+    D("%zu patterns, %zu states, %d classes\n", patterns.size(), values.size(), classCount);
+}
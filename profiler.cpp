@@ -0,0 +1,508 @@
+#include "launcher.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <vector>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <algorithm>
+
+std::atomic<bool> profilerEnabled(false);
+
+static std::mutex ringsLock;
+static std::vector<ProfileRing *> rings;
+
+// event arguments outlive the IOCs and folders they name
+static std::mutex stringsLock;
+static std::unordered_set<std::string> strings;
+
+// frame boundaries, written by the main thread
+static uint64_t frameStarts[PROFILER_FRAMES];
+static std::atomic<uint64_t> frameCount(0);
+
+// gives the ring back when the thread exits
+struct ProfileRingOwner {
+    ProfileRing * ring;
+    // rings are only taken once the profiler is on, the name waits here
+    char name[32];
+    ~ProfileRingOwner() {
+        if (ring) {
+            ring->owned = false;
+        }
+    }
+};
+static thread_local ProfileRingOwner owner;
+
+// ring of the calling thread, created on first use
+ProfileRing * profilerRing(void) {
+    if (owner.ring) {
+        return owner.ring;
+    }
+    std::lock_guard<std::mutex> guard(ringsLock);
+    ProfileRing * ring = NULL;
+    for (size_t n = 0; n < rings.size() && ! ring; n++) {
+        if (! rings[n]->owned) {
+            ring = rings[n];
+        }
+    }
+    if (! ring) {
+        ring = new ProfileRing();
+        ring->head = 0;
+        rings.push_back(ring);
+    }
+    ring->owned = true;
+    ring->depth = 0;
+    if (owner.name[0]) {
+        strcpy(ring->name, owner.name);
+    } else {
+        snprintf(ring->name, sizeof(ring->name), "thread %zu", rings.size() - 1);
+    }
+    owner.ring = ring;
+    return ring;
+}
+
+void profilerThreadName(const char * _name) {
+    snprintf(owner.name, sizeof(owner.name), "%s", _name);
+    if (owner.ring) {
+        std::lock_guard<std::mutex> guard(ringsLock);
+        strcpy(owner.ring->name, owner.name);
+    }
+}
+
+const char * profilerIntern(const char * _str) {
+    std::lock_guard<std::mutex> guard(stringsLock);
+    return strings.insert(_str).first->c_str();
+}
+
+// called by the main loop at the start of every frame
+void profilerFrame(void) {
+    if (! profilerEnabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    uint64_t n = frameCount.load(std::memory_order_relaxed);
+    frameStarts[n & (PROFILER_FRAMES - 1)] = profilerNow();
+    frameCount.store(n + 1, std::memory_order_release);
+}
+
+// events of one ring
+struct ProfileLane {
+    char name[32];
+    std::vector<ProfileEvent> events;
+};
+
+static void writeJsonString(FILE * _fp, const char * _str) {
+    fputc('"', _fp);
+    for (const char * p = _str; *p; p++) {
+        if (*p == '"' || *p == '\\') {
+            fprintf(_fp, "\\%c", *p);
+        } else if ((unsigned char)*p < 0x20) {
+            fprintf(_fp, "\\u%04x", *p);
+        } else {
+            fputc(*p, _fp);
+        }
+    }
+    fputc('"', _fp);
+}
+
+// write the events between _from and _to in the Chrome trace event format,
+// loads in Perfetto and chrome://tracing; frames go to a track of their
+// own, every ring is a thread. _first is set to the oldest time the rings
+// still cover, later than _from if they wrapped during the capture
+bool profilerWriteTrace(const char * _path, uint64_t _from, uint64_t _to, size_t * _events, uint64_t * _first) {
+    FILE * fp = fopen(_path, "w");
+    if (! fp) {
+        E("fopen() %s failed %s\n", _path, strerror(errno));
+        return false;
+    }
+    *_events = 0;
+    *_first = _from;
+    int pid = getpid();
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"gen2oll\"}},\n", pid);
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":0,\"args\":{\"name\":\"frames\"}}", pid);
+
+    uint64_t count = frameCount.load(std::memory_order_acquire);
+    uint64_t oldest = (count > PROFILER_FRAMES) ? count - PROFILER_FRAMES : 0;
+    for (uint64_t n = oldest; n + 1 < count; n++) {
+        uint64_t start = frameStarts[n & (PROFILER_FRAMES - 1)];
+        uint64_t end = frameStarts[(n + 1) & (PROFILER_FRAMES - 1)];
+        if (start < _from || end > _to) {
+            continue;
+        }
+        fprintf(fp, ",\n{\"name\":\"frame\",\"ph\":\"X\",\"pid\":%d,\"tid\":0,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+            pid, (start - _from) / 1e3, (end - start) / 1e3, (unsigned long long)n);
+        (*_events)++;
+    }
+
+    // copy the rings first, the owners keep writing
+    std::vector<ProfileLane> lanes;
+    {
+        std::lock_guard<std::mutex> guard(ringsLock);
+        lanes.resize(rings.size());
+        for (size_t r = 0; r < rings.size(); r++) {
+            ProfileRing * ring = rings[r];
+            strcpy(lanes[r].name, ring->name);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t oldest = (head > PROFILER_EVENTS) ? head - PROFILER_EVENTS : 0;
+            for (uint64_t n = oldest; n < head; n++) {
+                lanes[r].events.push_back(ring->events[n & (PROFILER_EVENTS - 1)]);
+            }
+            // the writer fills slot head before it publishes head + 1, a
+            // full ring's oldest slot may be half written; the fence keeps
+            // the copies above from moving past the load
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t now = ring->head.load(std::memory_order_acquire);
+            if (now - oldest >= PROFILER_EVENTS) {
+                size_t stale = std::min<uint64_t>(now - oldest - PROFILER_EVENTS + 1, lanes[r].events.size());
+                lanes[r].events.erase(lanes[r].events.begin(), lanes[r].events.begin() + stale);
+            }
+            // the ring wrapped, what came before is lost
+            if (oldest && lanes[r].events.size() && lanes[r].events[0].start > *_first) {
+                *_first = lanes[r].events[0].start;
+            }
+        }
+    }
+
+    for (size_t r = 0; r < lanes.size(); r++) {
+        int tid = r + 1;
+        fprintf(fp, ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":", pid, tid);
+        writeJsonString(fp, lanes[r].name);
+        fprintf(fp, "}}");
+
+        for (size_t e = 0; e < lanes[r].events.size(); e++) {
+            const ProfileEvent & event = lanes[r].events[e];
+            if (event.start < _from || event.start > _to) {
+                continue;
+            }
+            fprintf(fp, ",\n{\"name\":");
+            writeJsonString(fp, event.name);
+            if (event.kind == PROFILE_EVENT_ZONE) {
+                fprintf(fp, ",\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                    pid, tid, (event.start - _from) / 1e3, (event.end - event.start) / 1e3);
+            } else if (event.kind == PROFILE_EVENT_INSTANT) {
+                fprintf(fp, ",\"ph\":\"i\",\"s\":\"t\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f",
+                    pid, tid, (event.start - _from) / 1e3);
+            } else {
+                fprintf(fp, ",\"ph\":\"C\",\"pid\":%d,\"tid\":%d,\"ts\":%.3f,\"args\":{\"value\":%llu}",
+                    pid, tid, (event.start - _from) / 1e3, (unsigned long long)event.end);
+            }
+            if (event.arg) {
+                fprintf(fp, ",\"args\":{\"arg\":");
+                writeJsonString(fp, event.arg);
+                fprintf(fp, "}");
+            }
+            fprintf(fp, "}");
+            (*_events)++;
+        }
+    }
+    fprintf(fp, "\n]}\n");
+
+    bool ok = (fflush(fp) == 0);
+    if (fclose(fp) != 0 || ! ok) {
+        E("writing %s failed %s\n", _path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// what the overlay shows, taken from the rings unless paused
+struct ProfileZoneStats {
+    const char * name;
+    // time spent per frame, for the frames the zone ran in
+    std::vector<uint64_t> perFrame;
+    size_t calls;
+    uint64_t p50;
+    uint64_t p99;
+};
+
+struct ProfileSnapshot {
+    std::vector<uint64_t> frames;
+    std::vector<ProfileLane> lanes;
+    std::vector<ProfileZoneStats> zones;
+    uint64_t frameP50;
+    uint64_t frameP99;
+};
+
+static uint64_t percentile(std::vector<uint64_t> & _values, int _pct) {
+    if (_values.empty()) {
+        return 0;
+    }
+    std::sort(_values.begin(), _values.end());
+    return _values[(_values.size() - 1) * _pct / 100];
+}
+
+// copy the events of the last _frames frames out of the rings and work out
+// the per zone statistics
+static void takeSnapshot(ProfileSnapshot & _snap, int _frames) {
+    _snap.frames.clear();
+    _snap.lanes.clear();
+    _snap.zones.clear();
+    _snap.frameP50 = _snap.frameP99 = 0;
+
+    uint64_t count = frameCount.load(std::memory_order_acquire);
+    uint64_t first = (count > (uint64_t)_frames + 1) ? count - _frames - 1 : 0;
+    for (uint64_t n = first; n < count; n++) {
+        _snap.frames.push_back(frameStarts[n & (PROFILER_FRAMES - 1)]);
+    }
+    if (_snap.frames.size() < 2) {
+        return;
+    }
+    uint64_t from = _snap.frames.front();
+    uint64_t to = _snap.frames.back();
+
+    {
+        std::lock_guard<std::mutex> guard(ringsLock);
+        for (size_t r = 0; r < rings.size(); r++) {
+            ProfileRing * ring = rings[r];
+            ProfileLane lane;
+            strcpy(lane.name, ring->name);
+            uint64_t head = ring->head.load(std::memory_order_acquire);
+            uint64_t oldest = (head > PROFILER_EVENTS) ? head - PROFILER_EVENTS : 0;
+            // events are in the order they ended
+            for (uint64_t n = head; n > oldest; n--) {
+                const ProfileEvent & event = ring->events[(n - 1) & (PROFILER_EVENTS - 1)];
+                if (event.end < from) {
+                    break;
+                }
+                if (event.start < to) {
+                    lane.events.push_back(event);
+                }
+            }
+            // the writer might have wrapped over what we just read, or be
+            // writing the oldest slot of a full ring before it publishes it
+            std::atomic_thread_fence(std::memory_order_acquire);
+            uint64_t now = ring->head.load(std::memory_order_acquire);
+            if (now - oldest >= PROFILER_EVENTS) {
+                size_t stale = std::min<uint64_t>(now - oldest - PROFILER_EVENTS + 1, lane.events.size());
+                lane.events.resize(lane.events.size() - stale);
+            }
+            if (lane.events.size()) {
+                _snap.lanes.push_back(lane);
+            }
+        }
+    }
+
+    std::vector<uint64_t> frameTimes;
+    for (size_t n = 1; n < _snap.frames.size(); n++) {
+        frameTimes.push_back(_snap.frames[n] - _snap.frames[n - 1]);
+    }
+    _snap.frameP50 = percentile(frameTimes, 50);
+    _snap.frameP99 = percentile(frameTimes, 99);
+
+    // time per zone per frame; nested calls of the same zone count once
+    std::unordered_map<const char *, size_t> byName;
+    size_t frames = _snap.frames.size() - 1;
+    for (size_t l = 0; l < _snap.lanes.size(); l++) {
+        for (size_t e = 0; e < _snap.lanes[l].events.size(); e++) {
+            const ProfileEvent & event = _snap.lanes[l].events[e];
+            if (event.start < from) {
+                continue;
+            }
+            size_t frame = std::upper_bound(_snap.frames.begin(), _snap.frames.end(), event.start) - _snap.frames.begin() - 1;
+            auto it = byName.find(event.name);
+            if (it == byName.end()) {
+                ProfileZoneStats zone;
+                zone.name = event.name;
+                zone.perFrame.assign(frames, 0);
+                zone.calls = 0;
+                zone.p50 = zone.p99 = 0;
+                it = byName.insert(std::make_pair(event.name, _snap.zones.size())).first;
+                _snap.zones.push_back(zone);
+            }
+            ProfileZoneStats & zone = _snap.zones[it->second];
+            zone.perFrame[frame] += event.end - event.start;
+            zone.calls++;
+        }
+    }
+    for (size_t z = 0; z < _snap.zones.size(); z++) {
+        ProfileZoneStats & zone = _snap.zones[z];
+        std::vector<uint64_t> ran;
+        for (size_t f = 0; f < frames; f++) {
+            if (zone.perFrame[f]) {
+                ran.push_back(zone.perFrame[f]);
+            }
+        }
+        zone.perFrame.swap(ran);
+        zone.p50 = percentile(zone.perFrame, 50);
+        zone.p99 = percentile(zone.perFrame, 99);
+    }
+    std::sort(_snap.zones.begin(), _snap.zones.end(), [](const ProfileZoneStats & a, const ProfileZoneStats & b) {
+        return a.p99 > b.p99;
+    });
+}
+
+static ImU32 zoneColor(const char * _name) {
+    // same zone, same color
+    uint32_t hash = 2166136261u;
+    for (const char * p = _name; *p; p++) {
+        hash = (hash ^ (unsigned char)*p) * 16777619u;
+    }
+    return IM_COL32(80 + hash % 150, 80 + (hash >> 8) % 150, 80 + (hash >> 16) % 150, 255);
+}
+
+// the zones of one frame, a lane per thread, nested zones below their parents
+static void drawFlame(ProfileSnapshot & _snap, size_t _frame) {
+    uint64_t from = _snap.frames[_frame];
+    uint64_t to = _snap.frames[_frame + 1];
+    float rowHeight = ImGui::GetTextLineHeightWithSpacing();
+    ImDrawList * drawList = ImGui::GetWindowDrawList();
+
+    for (size_t l = 0; l < _snap.lanes.size(); l++) {
+        ProfileLane & lane = _snap.lanes[l];
+        int depth = 0;
+        for (size_t e = 0; e < lane.events.size(); e++) {
+            const ProfileEvent & event = lane.events[e];
+            if (event.end > from && event.start < to) {
+                depth = std::max(depth, event.depth + 1);
+            }
+        }
+        if (depth == 0) {
+            continue;
+        }
+        ImGui::TextDisabled("%s", lane.name);
+        ImVec2 origin = ImGui::GetCursorScreenPos();
+        float width = ImGui::GetContentRegionAvail().x;
+        ImGui::InvisibleButton(lane.name, ImVec2(width, rowHeight * depth));
+        bool hovered = ImGui::IsItemHovered();
+        ImVec2 mouse = ImGui::GetIO().MousePos;
+        double scale = width / (double)(to - from);
+
+        for (size_t e = 0; e < lane.events.size(); e++) {
+            const ProfileEvent & event = lane.events[e];
+            if (event.end <= from || event.start >= to) {
+                continue;
+            }
+            float x0 = origin.x + (std::max(event.start, from) - from) * scale;
+            float x1 = origin.x + (std::min(event.end, to) - from) * scale;
+            float y0 = origin.y + event.depth * rowHeight;
+            ImVec2 min(x0, y0);
+            ImVec2 max(std::max(x1, x0 + 1.0f), y0 + rowHeight - 1.0f);
+            drawList->AddRectFilled(min, max, zoneColor(event.name));
+            if (ImGui::CalcTextSize(event.name).x < max.x - min.x) {
+                drawList->AddText(ImVec2(min.x + 2.0f, min.y), IM_COL32_BLACK, event.name);
+            }
+            if (hovered && mouse.x >= min.x && mouse.x < max.x && mouse.y >= min.y && mouse.y < max.y) {
+                ImGui::SetTooltip("%s %.3f ms", event.name, (event.end - event.start) / 1e6);
+            }
+        }
+    }
+}
+
+// write what was recorded since _from next to the cache, for bug reports
+static void saveTrace(uint64_t _from, char * _status, size_t _size) {
+    char dir[512];
+    if (! launcherUserDir("XDG_CACHE_HOME", ".cache", dir, sizeof(dir), true)) {
+        snprintf(_status, _size, "no folder for the trace");
+        return;
+    }
+    char path[600];
+    char stamp[32];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    snprintf(path, sizeof(path), "%s/trace-%s.json", dir, stamp);
+
+    size_t events;
+    uint64_t first;
+    if (! profilerWriteTrace(path, _from, profilerNow(), &events, &first)) {
+        snprintf(_status, _size, "writing %s failed", path);
+    } else if (first > _from) {
+        snprintf(_status, _size, "%zu events in %s, the first %.1f s were overwritten", events, path, (first - _from) / 1e9);
+    } else {
+        snprintf(_status, _size, "%zu events in %s", events, path);
+    }
+}
+
+// profiler overlay: frame times of the last frames, the zones of the
+// selected frame and p50/p99 per zone
+void profilerDraw(bool * _open) {
+    static ProfileSnapshot snap;
+    static int frames = 120;
+    static bool paused = false;
+    // frames back from the newest one
+    static int selected = 0;
+    // trace capture started at, 0 if not recording
+    static uint64_t traceStart = 0;
+    static char traceStatus[700] = "";
+
+    ImGui::SetNextWindowSize(ImVec2(720, 560), ImGuiCond_FirstUseEver);
+    if (! ImGui::Begin("Profiler", _open)) {
+        ImGui::End();
+        return;
+    }
+    if (! paused) {
+        takeSnapshot(snap, frames);
+    }
+
+    ImGui::Checkbox("pause", &paused);
+    ImGui::SameLine();
+    ImGui::PushItemWidth(120);
+    ImGui::SliderInt("frames", &frames, 10, PROFILER_FRAMES - 2);
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (! traceStart) {
+        if (ImGui::Button("Record trace")) {
+            traceStart = profilerNow();
+            traceStatus[0] = '\0';
+        }
+    } else {
+        if (ImGui::Button("Save trace")) {
+            saveTrace(traceStart, traceStatus, sizeof(traceStatus));
+            traceStart = 0;
+        } else {
+            ImGui::SameLine();
+            ImGui::Text("recording %.1f s", (profilerNow() - traceStart) / 1e9);
+        }
+    }
+    if (traceStatus[0]) {
+        ImGui::TextDisabled("%s", traceStatus);
+    }
+    if (snap.frames.size() < 2) {
+        ImGui::Text("no frames recorded yet");
+        ImGui::End();
+        return;
+    }
+    size_t count = snap.frames.size() - 1;
+    ImGui::SameLine();
+    ImGui::Text("frame p50 %.2f ms, p99 %.2f ms", snap.frameP50 / 1e6, snap.frameP99 / 1e6);
+
+    // frame times, click a bar to look at that frame
+    std::vector<float> times(count);
+    for (size_t n = 0; n < count; n++) {
+        times[n] = (snap.frames[n + 1] - snap.frames[n]) / 1e6;
+    }
+    ImGui::PlotHistogram("##frames", times.data(), count, 0, NULL, 0.0f, FLT_MAX, ImVec2(-1.0f, 60.0f));
+    if (ImGui::IsItemHovered() && ImGui::IsMouseClicked(0)) {
+        float x = (ImGui::GetIO().MousePos.x - ImGui::GetItemRectMin().x) / ImGui::GetItemRectSize().x;
+        selected = count - 1 - std::min((size_t)(x * count), count - 1);
+    }
+    selected = std::min(selected, (int)count - 1);
+    size_t frame = count - 1 - selected;
+    ImGui::Text("frame -%d, %.3f ms", selected, times[frame]);
+
+    ImGui::BeginChild("flame", ImVec2(0, ImGui::GetContentRegionAvail().y * 0.5f), true);
+    drawFlame(snap, frame);
+    ImGui::EndChild();
+
+    ImGui::BeginChild("zones");
+    ImGui::Columns(5, "zones");
+    ImGui::Text("zone"); ImGui::NextColumn();
+    ImGui::Text("calls / frame"); ImGui::NextColumn();
+    ImGui::Text("p50 ms"); ImGui::NextColumn();
+    ImGui::Text("p99 ms"); ImGui::NextColumn();
+    ImGui::Text("frames"); ImGui::NextColumn();
+    ImGui::Separator();
+    for (size_t z = 0; z < snap.zones.size(); z++) {
+        ProfileZoneStats & zone = snap.zones[z];
+        ImGui::Text("%s", zone.name); ImGui::NextColumn();
+        ImGui::Text("%.1f", zone.perFrame.size() ? (double)zone.calls / zone.perFrame.size() : 0.0); ImGui::NextColumn();
+        ImGui::Text("%.3f", zone.p50 / 1e6); ImGui::NextColumn();
+        ImGui::Text("%.3f", zone.p99 / 1e6); ImGui::NextColumn();
+        ImGui::Text("%zu", zone.perFrame.size()); ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+    ImGui::EndChild();
+
+    ImGui::End();
+}
@@ -0,0 +1,129 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <stdint.h>
+#include <time.h>
+#include <atomic>
+
+// scoped timing zones:
+//   void foo(void) {
+//       PROFILE_ZONE("foo");
+//       ..
+//   }
+// zones are recorded into a ring per thread and shown by profilerDraw();
+// while the profiler is off a zone costs a load and a branch, built with
+// -DNO_PROFILER the zones are gone altogether
+//
+// PROFILE_ZONE_ARG(), PROFILE_INSTANT() and PROFILE_COUNTER() are only
+// of interest in a trace, see profilerWriteTrace()
+
+// per thread, power of two
+#define PROFILER_EVENTS         16384
+// frame boundaries kept, power of two
+#define PROFILER_FRAMES         512
+
+enum {
+    PROFILE_EVENT_ZONE = 0,
+    PROFILE_EVENT_INSTANT,
+    PROFILE_EVENT_COUNTER,
+};
+
+struct ProfileEvent {
+    const char * name;
+    // interned by profilerIntern(), or NULL
+    const char * arg;
+    uint64_t start;
+    // or the value of a counter
+    uint64_t end;
+    int depth;
+    int kind;
+};
+
+// written by the owning thread only, read by the overlay
+struct ProfileRing {
+    ProfileEvent events[PROFILER_EVENTS];
+    // number of events ever written
+    std::atomic<uint64_t> head;
+    // reused once the thread is gone
+    std::atomic<bool> owned;
+    int depth;
+    char name[32];
+};
+
+extern std::atomic<bool> profilerEnabled;
+
+// nanoseconds
+static inline uint64_t profilerNow(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+ProfileRing * profilerRing(void);
+void profilerThreadName(const char * _name);
+const char * profilerIntern(const char * _str);
+void profilerFrame(void);
+void profilerDraw(bool * _open);
+bool profilerWriteTrace(const char * _path, uint64_t _from, uint64_t _to, size_t * _events, uint64_t * _first);
+
+static inline void profilerRecord(ProfileRing * _ring, int _kind, const char * _name, const char * _arg, uint64_t _start, uint64_t _end) {
+    uint64_t n = _ring->head.load(std::memory_order_relaxed);
+    ProfileEvent & event = _ring->events[n & (PROFILER_EVENTS - 1)];
+    event.name = _name;
+    event.arg = _arg;
+    event.start = _start;
+    event.end = _end;
+    event.depth = _ring->depth;
+    event.kind = _kind;
+    _ring->head.store(n + 1, std::memory_order_release);
+}
+
+static inline void profilerEvent(int _kind, const char * _name, const char * _arg, uint64_t _value) {
+    if (! profilerEnabled.load(std::memory_order_relaxed)) {
+        return;
+    }
+    profilerRecord(profilerRing(), _kind, _name, _arg ? profilerIntern(_arg) : NULL, profilerNow(), _value);
+}
+
+struct ProfileScope {
+    ProfileRing * ring;
+    const char * name;
+    const char * arg;
+    uint64_t start;
+
+    ProfileScope(const char * _name, const char * _arg = NULL) {
+        if (! profilerEnabled.load(std::memory_order_relaxed)) {
+            ring = NULL;
+            return;
+        }
+        ring = profilerRing();
+        name = _name;
+        arg = _arg ? profilerIntern(_arg) : NULL;
+        ring->depth++;
+        start = profilerNow();
+    }
+    ~ProfileScope() {
+        if (! ring) {
+            return;
+        }
+        uint64_t end = profilerNow();
+        ring->depth--;
+        profilerRecord(ring, PROFILE_EVENT_ZONE, name, arg, start, end);
+    }
+};
+
+#define PROFILE_CONCAT2(_a, _b)     _a##_b
+#define PROFILE_CONCAT(_a, _b)      PROFILE_CONCAT2(_a, _b)
+#ifndef NO_PROFILER
+#define PROFILE_ZONE(_name)         ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(_name)
+#define PROFILE_ZONE_ARG(_name, _arg) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(_name, _arg)
+#define PROFILE_INSTANT(_name, _arg) profilerEvent(PROFILE_EVENT_INSTANT, _name, _arg, 0)
+#define PROFILE_COUNTER(_name, _value) profilerEvent(PROFILE_EVENT_COUNTER, _name, NULL, _value)
+#else
+#define PROFILE_ZONE(_name)
+#define PROFILE_ZONE_ARG(_name, _arg)
+#define PROFILE_INSTANT(_name, _arg)
+#define PROFILE_COUNTER(_name, _value)
+#endif
+
+#endif // PROFILER_H
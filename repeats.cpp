@@ -0,0 +1,154 @@
+#include "launcher.h"
+
+#include <stdio.h>
+
+static inline bool isDigit(char _c) {
+    return _c >= '0' && _c <= '9';
+}
+
+// same text once the numbers are taken out; a timestamp is numbers too
+static bool sameShape(const char * _a, const char * _aEnd, const char * _b, const char * _bEnd) {
+    while (_a < _aEnd && _b < _bEnd) {
+        if (isDigit(*_a) && isDigit(*_b)) {
+            while (_a < _aEnd && isDigit(*_a)) {
+                _a++;
+            }
+            while (_b < _bEnd && isDigit(*_b)) {
+                _b++;
+            }
+            continue;
+        }
+        if (*_a != *_b) {
+            return false;
+        }
+        _a++;
+        _b++;
+    }
+    return _a == _aEnd && _b == _bEnd;
+}
+
+// a line about to be added that says what the last one said is kept as a
+// repeat of it; false if it is not one
+bool ChildData::addRepeat(const char * _line, uint64_t _mono) {
+    if (! lineOffsets.Size || strstr(_line, LATENCY_MARKER)) {
+        return false;
+    }
+    uint32_t line = lineOffsets.Size - 1;
+    const char * end;
+    const char * start = lineText(line, &end);
+    if (! sameShape(start, end, _line, _line + strcspn(_line, "\n"))) {
+        return false;
+    }
+    // parseColors() found the same colors as for the first one
+    while (spans.size() && spans.back().line > line) {
+        spans.pop_back();
+    }
+    if (repeats.empty() || repeats.back().line != line) {
+        repeats.push_back(LogRepeat());
+        repeats.back().line = line;
+        repeats.back().count = 0;
+        repeats.back().lastMono = stamps.last;
+    }
+    LogRepeat & repeat = repeats.back();
+    for (const char * p = _line; *p; p++) {
+        if (isDigit(*p)) {
+            const char * run = p;
+            while (isDigit(p[1])) {
+                p++;
+            }
+            repeat.numbers.append(run, p + 1 - run);
+            repeat.numbers += ' ';
+        }
+    }
+    repeat.numbers += '\n';
+    uint64_t delta = (_mono > repeat.lastMono) ? _mono - repeat.lastMono : 0;
+    while (delta >= 0x80) {
+        repeat.times.push_back((delta & 0x7f) | 0x80);
+        delta >>= 7;
+    }
+    repeat.times.push_back(delta);
+    repeat.count++;
+    repeat.lastMono = std::max(_mono, repeat.lastMono);
+    return true;
+}
+
+// the line and all its repeats, with the numbers of each; the repeats are
+// decoded from the first one up to the last row in view
+void ChildData::drawRepeats(void) {
+    if (expandLine < 0) {
+        return;
+    }
+    if (! ImGui::BeginPopup(name)) {
+        expandLine = -1;
+        return;
+    }
+    LogRepeat * repeat = findRepeat(expandLine);
+    if (! repeat) {
+        // the log was cleared
+        ImGui::CloseCurrentPopup();
+        ImGui::EndPopup();
+        return;
+    }
+    const char * end;
+    const char * start = lineText(expandLine, &end);
+    uint64_t mono = stamps.mono(expandLine);
+    int64_t offset = stamps.wallOffset(expandLine);
+    ImGui::Text("said %u times in %.3f s", repeat->count + 1, (repeat->lastMono - mono) * 1e-6);
+    ImGui::Separator();
+
+    ImGui::BeginChild("repeats", ImVec2(700, std::min(repeat->count + 1, 20u) * ImGui::GetTextLineHeightWithSpacing()));
+    ImGuiListClipper clipper;
+    clipper.Begin(repeat->count + 1);
+    while (clipper.Step()) {
+        const char * numbers = repeat->numbers.c_str();
+        const unsigned char * times = repeat->times.data();
+        uint64_t at = mono;
+        std::string text;
+        for (int row = 0; row < clipper.DisplayEnd; row++) {
+            if (row) {
+                uint64_t delta = 0;
+                for (int shift = 0; ; shift += 7) {
+                    delta |= (uint64_t)(*times & 0x7f) << shift;
+                    if (! (*times++ & 0x80)) {
+                        break;
+                    }
+                }
+                at += delta;
+            }
+            if (row < clipper.DisplayStart) {
+                if (row) {
+                    numbers = strchr(numbers, '\n') + 1;
+                }
+                continue;
+            }
+            // the first line with the numbers of the repeat in place of its own
+            text.clear();
+            for (const char * p = start; p < end; p++) {
+                if (! row || ! isDigit(*p)) {
+                    text += *p;
+                    continue;
+                }
+                while (p + 1 < end && isDigit(p[1])) {
+                    p++;
+                }
+                const char * space = strchr(numbers, ' ');
+                text.append(numbers, space - numbers);
+                numbers = space + 1;
+            }
+            if (row) {
+                // past the newline
+                numbers++;
+            }
+            int64_t wall = at + offset;
+            time_t sec = wall / 1000000;
+            struct tm tm;
+            localtime_r(&sec, &tm);
+            ImGui::TextDisabled("%02d:%02d:%02d.%03d", tm.tm_hour, tm.tm_min, tm.tm_sec, (int)(wall % 1000000 / 1000));
+            ImGui::SameLine();
+            ImGui::TextUnformatted(text.c_str(), text.c_str() + text.size());
+        }
+    }
+    clipper.End();
+    ImGui::EndChild();
+    ImGui::EndPopup();
+}
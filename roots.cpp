@@ -0,0 +1,127 @@
+#include "launcher.h"
+
+#include <stdio.h>
+#include <errno.h>
+
+// roots configuration, one root per line:
+//   strategy scan-period max-threads path
+// for example:
+//   auto 300 4 /data/bdee
+//   periodic 600 8 /mnt/nfs/bdee
+
+#define ROOT_DEFAULT_PATH       "/data/bdee"
+#define ROOT_DEFAULT_PERIOD     300.0
+#define ROOT_DEFAULT_THREADS    4
+
+static const char * strategyNames[] = { "auto", "watch", "periodic" };
+
+// $XDG_CONFIG_HOME/gen2oll/roots or ~/.config/gen2oll/roots
+static bool rootsPath(char * _path, size_t _size, bool _create) {
+    char dir[512];
+    if (! launcherUserDir("XDG_CONFIG_HOME", ".config", dir, sizeof(dir), _create)) {
+        return false;
+    }
+    snprintf(_path, _size, "%s/roots", dir);
+    return true;
+}
+
+IocRoot * IocList::findRoot(const char * _path) {
+    for (size_t n = 0; n < roots.size(); n++) {
+        if (strcmp(roots[n]->path, _path) == 0) {
+            return roots[n];
+        }
+    }
+    return NULL;
+}
+
+IocRoot * IocList::addRoot(const char * _path, int _strategy, double _scanPeriod, int _maxThreads) {
+    IocRoot * root = new IocRoot(_path, _strategy, _scanPeriod, _maxThreads);
+    if (strlen(root->path) == 0 || findRoot(root->path)) {
+        E("root '%s' empty or already listed\n", _path);
+        delete root;
+        return NULL;
+    }
+    roots.push_back(root);
+    D("added root %s, %s\n", root->path, strategyNames[root->strategy]);
+    return root;
+}
+
+// forget the root and its IOCs; a scan still running is left to finish on its own
+void IocList::removeRoot(IocRoot * _root) {
+    for (size_t n = 0; n < roots.size(); n++) {
+        if (roots[n] == _root) {
+            roots.erase(roots.begin() + n);
+            break;
+        }
+    }
+    D("removing root %s\n", _root->path);
+    _root->watcher.stop();
+    if (removeIocs(_root, false)) {
+        cacheDirty = true;
+    }
+    // the running ones stay, without a root
+    for (size_t n = 0; n < list.size(); n++) {
+        if (list[n]->root == _root) {
+            list[n]->root = NULL;
+        }
+    }
+    delete _root;
+}
+
+bool IocList::loadRoots(void) {
+    char path[1024];
+    FILE * fp = NULL;
+    if (rootsPath(path, sizeof(path), false)) {
+        fp = fopen(path, "r");
+    }
+    if (! fp) {
+        D("no roots configured, using %s\n", ROOT_DEFAULT_PATH);
+        addRoot(ROOT_DEFAULT_PATH, ROOT_AUTO, ROOT_DEFAULT_PERIOD, ROOT_DEFAULT_THREADS);
+        return false;
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp)) {
+        char strategy[16];
+        char rootPath[512];
+        double period;
+        int threads;
+        if (line[0] == '#' || sscanf(line, "%15s %lf %d %511[^\n]", strategy, &period, &threads, rootPath) != 4) {
+            continue;
+        }
+        int n = 0;
+        while (n < IM_ARRAYSIZE(strategyNames) && strcmp(strategy, strategyNames[n]) != 0) {
+            n++;
+        }
+        if (n == IM_ARRAYSIZE(strategyNames)) {
+            E("unknown strategy %s for root %s\n", strategy, rootPath);
+            n = ROOT_AUTO;
+        }
+        addRoot(rootPath, n, period, threads);
+    }
+    fclose(fp);
+    D("loaded %zu roots from %s\n", roots.size(), path);
+    return true;
+}
+
+bool IocList::saveRoots(void) {
+    char path[1024];
+    if (! rootsPath(path, sizeof(path), true)) {
+        return false;
+    }
+    FILE * fp = fopen(path, "w");
+    if (! fp) {
+        E("fopen() %s failed %s\n", path, strerror(errno));
+        return false;
+    }
+    fprintf(fp, "# strategy scan-period max-threads path\n");
+    for (size_t n = 0; n < roots.size(); n++) {
+        IocRoot * root = roots[n];
+        fprintf(fp, "%s %g %d %s\n", strategyNames[root->strategy], root->scanPeriod, root->maxThreads, root->path);
+    }
+    if (fclose(fp) != 0) {
+        E("writing %s failed %s\n", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
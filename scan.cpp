@@ -0,0 +1,305 @@
+#include "launcher.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <algorithm>
+
+// list the folder; the type of entries the file system did not tell us
+// about (DT_UNKNOWN on NFS, XFS without ftype, some FUSE mounts) and of
+// symlinks is looked up with statx(), on as many threads as _spare has
+// left (none if NULL) so that the round trips to a file server overlap;
+// returns the number of calls
+size_t readDirEntries(DIR * _dir, std::vector<IocDirEntry> & _entries, std::atomic<int> * _spare) {
+    struct dirent * entry;
+    std::vector<size_t> unknown;
+
+    _entries.clear();
+    while ((entry = readdir(_dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        IocDirEntry dirEntry;
+        strncpy(dirEntry.name, entry->d_name, sizeof(dirEntry.name) - 1);
+        dirEntry.name[sizeof(dirEntry.name) - 1] = '\0';
+        dirEntry.type = entry->d_type;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            unknown.push_back(_entries.size());
+        }
+        _entries.push_back(dirEntry);
+    }
+    if (unknown.empty()) {
+        return 0;
+    }
+
+    int fd = dirfd(_dir);
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t n;
+        while ((n = next++) < unknown.size()) {
+            IocDirEntry & dirEntry = _entries[unknown[n]];
+            struct statx stx;
+            // only the type is needed, and that never changes; do not make
+            // NFS revalidate the attributes; symlinks are followed
+            if (statx(fd, dirEntry.name, AT_STATX_DONT_SYNC, STATX_TYPE, &stx) == 0) {
+                dirEntry.type = IFTODT(stx.stx_mode);
+            } else {
+                dirEntry.type = DT_UNKNOWN;
+            }
+        }
+    };
+    // the threads the scan can spare, no more than there are lookups
+    int take = 0;
+    if (_spare && unknown.size() > 1) {
+        int have = *_spare;
+        do {
+            take = std::min<int>(have, unknown.size() - 1);
+        } while (take > 0 && ! _spare->compare_exchange_weak(have, have - take));
+        take = std::max(take, 0);
+    }
+    std::vector<std::thread> workers;
+    for (int n = 0; n < take; n++) {
+        workers.push_back(std::thread(worker));
+    }
+    worker();
+    for (size_t n = 0; n < workers.size(); n++) {
+        workers[n].join();
+    }
+    if (take) {
+        *_spare += take;
+    }
+    return unknown.size();
+}
+
+void IocScan::run(void) {
+    profilerThreadName("scan");
+    PROFILE_ZONE("IocScan::run");
+    D("scanning %s, up to %d threads\n", topPath, maxThreads);
+    network = isNetworkFs(topPath);
+    // this thread is the first of maxThreads
+    spare = maxThreads - 1;
+    IocVisited visited;
+    walk(topPath, 0, entries, visited);
+    // the same order every time, so the same one of the links to a stage wins
+    std::sort(stages.begin(), stages.end(), [](const char * a, const char * b) {
+        return strcmp(a, b) < 0;
+    });
+
+    // stages are walked in parallel, each worker picks the next one; on a
+    // network mount most of the time is spent waiting for the server
+    std::vector<std::vector<IocScanEntry>> results(stages.size());
+    std::atomic<size_t> next(0);
+    auto worker = [&]() {
+        size_t n;
+        while (! cancel && (n = next++) < stages.size()) {
+            PROFILE_ZONE("walk stage");
+            IocVisited stageVisited(visited);
+            walk(stages[n], 1, results[n], stageVisited);
+        }
+        // out of stages, the lookups of the others can use this thread
+        spare++;
+    };
+    std::vector<std::thread> workers;
+    for (size_t n = 1; n < (size_t)maxThreads && n < stages.size(); n++) {
+        spare--;
+        workers.push_back(std::thread([&]() {
+            profilerThreadName("scan worker");
+            worker();
+        }));
+    }
+    worker();
+    for (size_t n = 0; n < workers.size(); n++) {
+        workers[n].join();
+    }
+    // keep the parent first order of a single threaded walk
+    for (size_t n = 0; n < results.size(); n++) {
+        merge(results[n], visited);
+    }
+
+    resolve();
+    endTime = launcherTime();
+    D("scanned %s, %zu folders, %zu stat calls, %zu revisits in %.3f s\n", topPath, entries.size(),
+        (size_t)stats, (size_t)revisits, endTime - startTime);
+    done = true;
+    release();
+}
+
+// append the folders of a stage, minus the ones an earlier stage already
+// reached through a symlink (and everything below them)
+void IocScan::merge(std::vector<IocScanEntry> & _entries, IocVisited & _visited) {
+    std::string skip;
+    for (size_t n = 0; n < _entries.size(); n++) {
+        IocScanEntry & entry = _entries[n];
+        bool below = skip.size() && strncmp(entry.path, skip.c_str(), skip.size()) == 0 &&
+            entry.path[skip.size()] == '/';
+        if (! below) {
+            skip.clear();
+            if (_visited.insert(std::make_pair(entry.dev, entry.ino)).second) {
+                entries.push_back(entry);
+                continue;
+            }
+            D("[%d] skipping %s, seen already\n", entry.level, entry.path);
+            revisits++;
+            skip = entry.path;
+        }
+        free(entry.path);
+    }
+}
+
+// same traversal as IocList::listDir(), but only collects the folders; the
+// stages found in the top folder are left to the workers
+void IocScan::walk(const char * _name, int _level, std::vector<IocScanEntry> & _entries, IocVisited & _visited) {
+    DIR * dir;
+    struct stat st;
+
+    if (cancel) {
+        return;
+    }
+    PROFILE_ZONE_ARG("visit", _name);
+    if (!(dir = opendir(_name))) {
+        if (errno != ENOENT && errno != ENOTDIR) {
+            // EACCES on a stage being deployed, EIO or ESTALE on NFS
+            D("[%d] can not list %s %s\n", _level, _name, strerror(errno));
+            unreadable++;
+        }
+        return;
+    }
+    stats++;
+    // a symlink pointing up the tree, or another link to the same folder
+    if (fstat(dirfd(dir), &st) != 0 || ! _visited.insert(std::make_pair(st.st_dev, st.st_ino)).second) {
+        D("[%d] skipping %s, seen already\n", _level, _name);
+        revisits++;
+        closedir(dir);
+        return;
+    }
+
+    IocScanEntry scanEntry;
+    memset(&scanEntry, 0, sizeof(scanEntry));
+    scanEntry.path = strdup(_name);
+    scanEntry.level = _level;
+    scanEntry.mtime = st.st_mtim;
+    scanEntry.dev = st.st_dev;
+    scanEntry.ino = st.st_ino;
+    // parent folders are always listed before their children
+    size_t index = _entries.size();
+    _entries.push_back(scanEntry);
+
+    // local lookups are cheaper than starting threads
+    std::vector<IocDirEntry> dirEntries;
+    stats += readDirEntries(dir, dirEntries, network ? &spare : NULL);
+    closedir(dir);
+
+    for (size_t n = 0; n < dirEntries.size() && ! cancel; n++) {
+        IocDirEntry & entry = dirEntries[n];
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", _name, entry.name);
+        if (entry.type == DT_DIR) {
+            if (! IocList::wantDir(entry.name, _level)) {
+                continue;
+            }
+            if (_level == 0) {
+                stages.push_back(strdup(path));
+            } else {
+                walk(path, _level + 1, _entries, _visited);
+            }
+        } else if (_level == 3 && strcmp(entry.name, "instance.cmd") == 0) {
+            stats++;
+            if (stat(path, &st) == 0) {
+                _entries[index].hasCmd = true;
+                _entries[index].cmdMtime = st.st_mtim;
+            }
+        }
+    }
+}
+
+// resolve the macros of all the instances found, so that the main thread
+// does not have to touch the (possibly slow) mount; the memo makes this
+// cheap for instances and included files that did not change
+void IocScan::resolve(void) {
+    PROFILE_ZONE("IocScan::resolve");
+    engine.nextGeneration();
+    for (size_t n = 0; n < entries.size() && ! cancel; n++) {
+        IocScanEntry & entry = entries[n];
+        if (entry.level != 3 || ! entry.hasCmd) {
+            continue;
+        }
+        char stagePath[1024];
+        IocList::splitInstancePath(entry.path, stagePath, sizeof(stagePath));
+        MacroTable * macros = new MacroTable();
+        if (! engine.resolve(stagePath, entry.path, *macros, &entry.cmdMtime)) {
+            E("parsing %s/instance.cmd failed\n", entry.path);
+            delete macros;
+            continue;
+        }
+        entry.macros = macros;
+    }
+}
+
+// walk the IOC root in the background, see IocList::update()
+void IocList::startScan(IocRoot * _root) {
+    if (strlen(_root->path) == 0) {
+        E("empty root path\n");
+        return;
+    }
+    if (_root->scan) {
+        // restarting a scan stuck on a dead mount would only pile up threads
+        D("already scanning %s\n", _root->path);
+        return;
+    }
+    _root->scan = new IocScan(_root->path, _root->maxThreads, _root->engine);
+}
+
+// bring the IOCs of the root in line with what the background scan found;
+// nothing here touches the file system
+size_t IocList::applyScan(IocRoot * _root, IocScan * _scan) {
+    PROFILE_ZONE("applyScan");
+    size_t changes = 0;
+
+    // the memo is used by the next scan of this root
+    _root->engine.swap(_scan->engine);
+    _root->network = _scan->network;
+    _root->scanTime = _scan->endTime - _scan->startTime;
+    _root->scanStats = _scan->stats;
+
+    // NOTE: changes made between the walk and adding the watches are picked
+    // up by the next scan or poll only
+    if (_root->periodic()) {
+        _root->watcher.stop();
+    } else {
+        // inotify does not see changes made by other hosts
+        _root->watcher.start(_root->network);
+    }
+    for (size_t n = 0; n < list.size(); n++) {
+        if (list[n]->root == _root) {
+            list[n]->seen = false;
+        }
+    }
+
+    for (size_t n = 0; n < _scan->entries.size(); n++) {
+        IocScanEntry & entry = _scan->entries[n];
+        _root->watcher.add(entry.path, entry.level, entry.mtime, entry.cmdMtime);
+        if (entry.level != 3 || ! entry.macros) {
+            continue;
+        }
+
+        Ioc * ioc = findIoc(entry.path);
+        bool changed = ! ioc || ! sameMtime(ioc->dirMtime, entry.mtime) || ! sameMtime(ioc->cmdMtime, entry.cmdMtime);
+        if (applyInstance(_root, entry.path, *entry.macros, entry.mtime, entry.cmdMtime, entry.dev, entry.ino) && changed) {
+            changes++;
+        }
+    }
+
+    // instances that are gone; after a walk that did not get everywhere
+    // the missing ones may just have been out of reach, they are left for
+    // the next scan (started IOCs are never stopped, see dropIoc())
+    if (_scan->unreadable) {
+        D("scan of %s incomplete, %zu folders unreadable\n", _root->path, (size_t)_scan->unreadable);
+    } else {
+        changes += removeIocs(_root, true);
+    }
+
+    D("scan of %s applied, %zu changes, %zu IOCs\n", _root->path, changes, count());
+    return changes;
+}
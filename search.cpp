@@ -0,0 +1,359 @@
+#include "launcher.h"
+
+#include <stdio.h>
+#include <regex>
+
+static inline unsigned char foldCase(unsigned char _c) {
+    return (_c >= 'A' && _c <= 'Z') ? _c - 'A' + 'a' : _c;
+}
+
+// never 0, that marks a free slot; the text has no NUL bytes
+static inline uint32_t trigram(const char * _p) {
+    return foldCase(_p[0]) << 16 | foldCase(_p[1]) << 8 | foldCase(_p[2]);
+}
+
+static inline size_t trigramSlot(uint32_t _trigram, int _bits) {
+    return (_trigram * 2654435761u) >> (32 - _bits);
+}
+
+void LogSegment::add(uint32_t _trigram, uint64_t _block) {
+    if ((used + 1) * 2 > trigrams.size()) {
+        // a new table twice the size, at most half full
+        std::vector<LogTrigram> old;
+        old.swap(trigrams);
+        bits = old.size() ? bits + 1 : 10;
+        trigrams.assign((size_t)1 << bits, LogTrigram{0, 0});
+        used = 0;
+        for (size_t n = 0; n < old.size(); n++) {
+            if (old[n].trigram) {
+                add(old[n].trigram, old[n].blocks);
+            }
+        }
+    }
+    size_t mask = trigrams.size() - 1;
+    for (size_t n = trigramSlot(_trigram, bits); ; n = (n + 1) & mask) {
+        LogTrigram & slot = trigrams[n];
+        if (slot.trigram == _trigram) {
+            slot.blocks |= _block;
+            return;
+        }
+        if (! slot.trigram) {
+            slot.trigram = _trigram;
+            slot.blocks = _block;
+            used++;
+            return;
+        }
+    }
+}
+
+uint64_t LogSegment::find(uint32_t _trigram) {
+    if (! bits) {
+        auto it = std::lower_bound(trigrams.begin(), trigrams.end(), _trigram, [](const LogTrigram & a, uint32_t b) {
+            return a.trigram < b;
+        });
+        return (it != trigrams.end() && it->trigram == _trigram) ? it->blocks : 0;
+    }
+    size_t mask = trigrams.size() - 1;
+    for (size_t n = trigramSlot(_trigram, bits); trigrams[n].trigram; n = (n + 1) & mask) {
+        if (trigrams[n].trigram == _trigram) {
+            return trigrams[n].blocks;
+        }
+    }
+    return 0;
+}
+
+// the segment is full, sorted it takes a quarter of the table or less
+void LogSegment::seal(void) {
+    std::vector<LogTrigram> sorted;
+    sorted.reserve(used);
+    for (size_t n = 0; n < trigrams.size(); n++) {
+        if (trigrams[n].trigram) {
+            sorted.push_back(trigrams[n]);
+        }
+    }
+    std::sort(sorted.begin(), sorted.end(), [](const LogTrigram & a, const LogTrigram & b) {
+        return a.trigram < b.trigram;
+    });
+    trigrams.swap(sorted);
+    bits = 0;
+}
+
+void LogIndex::add(const char * _line, size_t _length) {
+    if (lines % LOG_SEGMENT_LINES == 0) {
+        if (segments.size()) {
+            segments.back().seal();
+        }
+        segments.push_back(LogSegment());
+    }
+    if (lines % LOG_BLOCK_LINES == 0) {
+        recent.assign(1024, 0);
+    }
+    LogSegment & segment = segments.back();
+    uint64_t block = (uint64_t)1 << (lines % LOG_SEGMENT_LINES / LOG_BLOCK_LINES);
+    lines++;
+    if (_length && _line[_length - 1] == '\n') {
+        _length--;
+    }
+    for (size_t n = 0; n + 3 <= _length; n++) {
+        uint32_t t = trigram(_line + n);
+        uint32_t & seen = recent[trigramSlot(t, 10)];
+        if (seen != t) {
+            seen = t;
+            segment.add(t, block);
+        }
+    }
+}
+
+uint64_t LogIndex::candidates(size_t _segment, const std::string & _text) {
+    LogSegment & segment = segments[_segment];
+    uint64_t blocks = ~(uint64_t)0;
+    for (size_t n = 0; n + 3 <= _text.size() && blocks; n++) {
+        blocks &= segment.find(trigram(_text.c_str() + n));
+    }
+    return blocks;
+}
+
+size_t LogIndex::bytes(void) {
+    size_t size = 0;
+    for (size_t n = 0; n < segments.size(); n++) {
+        size += segments[n].trigrams.capacity() * sizeof(LogTrigram);
+    }
+    return size;
+}
+
+struct LogQuery {
+    // plain text, case folded
+    std::string text;
+    bool regex;
+    std::regex re;
+    // text every match has, case folded, to pick the blocks to look at
+    std::vector<std::string> literals;
+
+    // a regex match; the text it has to have is looked for first, that is
+    // a lot cheaper than std::regex
+    bool match(const char * _start, const char * _end) {
+        for (size_t n = 0; n < literals.size(); n++) {
+            if (! logFind(_start, _end, literals[n])) {
+                return false;
+            }
+        }
+        return std::regex_search(_start, _end, re);
+    }
+};
+
+// runs of plain characters any match of _re has; anything that is not
+// plain ends a run, and with an alternation outside of a group nothing is
+// certain
+static void requiredLiterals(const char * _re, std::vector<std::string> & _literals) {
+    std::string run;
+    for (const char * p = _re; *p; p++) {
+        char c = *p;
+        if (c == '\\' && p[1] && ! isalnum((unsigned char)p[1])) {
+            c = *++p;
+        } else if (c == '|') {
+            // groups are skipped below, so this one is at the top
+            _literals.clear();
+            return;
+        } else if (strchr("\\.^$*+?()[]{}", c)) {
+            if (run.size() >= 3) {
+                _literals.push_back(run);
+            }
+            run.clear();
+            // skip what is in brackets and groups
+            if (c == '\\' && p[1]) {
+                p++;
+            } else if (c == '[') {
+                // a ] right at the start is one of the characters
+                p++;
+                p += (*p == '^');
+                p += (*p == ']');
+                while (*p && *p != ']') {
+                    p += (*p == '\\' && p[1]) ? 2 : 1;
+                }
+            } else if (c == '(') {
+                int depth = 1;
+                while (depth && p[1]) {
+                    p++;
+                    if (*p == '\\' && p[1]) {
+                        p++;
+                    } else {
+                        depth += (*p == '(') - (*p == ')');
+                    }
+                }
+            } else if (c == '{') {
+                while (p[1] && *p != '}') {
+                    p++;
+                }
+            }
+            if (! *p) {
+                break;
+            }
+            continue;
+        }
+        // the character may be left out, or repeated
+        if (p[1] == '?' || p[1] == '*' || p[1] == '{') {
+            if (run.size() >= 3) {
+                _literals.push_back(run);
+            }
+            run.clear();
+            continue;
+        }
+        run += foldCase(c);
+        if (p[1] == '+') {
+            if (run.size() >= 3) {
+                _literals.push_back(run);
+            }
+            run.clear();
+        }
+    }
+    if (run.size() >= 3) {
+        _literals.push_back(run);
+    }
+}
+
+// new search text, looked for from the first line by updateSearch()
+void ChildData::search(void) {
+    endSearch();
+    matches.clear();
+    searched = 0;
+    currentMatch = -1;
+    searchTime = 0.0;
+    if (! strlen(searchText)) {
+        return;
+    }
+    LogQuery * q = new LogQuery();
+    q->regex = searchRegex;
+    if (searchRegex) {
+        try {
+            q->re.assign(searchText, std::regex::ECMAScript | std::regex::icase | std::regex::nosubs | std::regex::optimize);
+        } catch (const std::regex_error & e) {
+            D("bad regex %s: %s\n", searchText, e.what());
+            delete q;
+            return;
+        }
+        requiredLiterals(searchText, q->literals);
+    } else {
+        for (const char * p = searchText; *p; p++) {
+            q->text += foldCase(*p);
+        }
+        q->literals.push_back(q->text);
+    }
+    query = q;
+}
+
+// the lines not looked at yet, through the index; a search that needs to
+// look at most of a long log, as a regex without plain text does, goes on
+// next frame after _budget seconds, 0 for no limit
+void ChildData::updateSearch(double _budget) {
+    size_t end = lineOffsets.Size;
+    if (! query || searched >= end) {
+        return;
+    }
+    PROFILE_ZONE_ARG("search", label);
+    double start = launcherTime();
+    while (searched < end) {
+        size_t segment = searched / LOG_SEGMENT_LINES;
+        uint64_t blocks = ~(uint64_t)0;
+        for (size_t n = 0; n < query->literals.size() && blocks; n++) {
+            blocks &= searchIndex.candidates(segment, query->literals[n]);
+        }
+        size_t segmentEnd = std::min((segment + 1) * LOG_SEGMENT_LINES, end);
+        // blocks before the first line not looked at are done
+        blocks &= ~(uint64_t)0 << (searched % LOG_SEGMENT_LINES / LOG_BLOCK_LINES);
+        while (blocks) {
+            size_t block = __builtin_ctzll(blocks);
+            blocks &= blocks - 1;
+            size_t line = std::max(segment * LOG_SEGMENT_LINES + block * LOG_BLOCK_LINES, searched);
+            size_t blockEnd = std::min(segment * LOG_SEGMENT_LINES + (block + 1) * LOG_BLOCK_LINES, segmentEnd);
+            if (line >= blockEnd) {
+                // past the last line of the last segment
+                break;
+            }
+            const char * base = linesBuffer.begin();
+            if (query->regex || compact) {
+                for (; line < blockEnd; line++) {
+                    const char * to;
+                    const char * from = lineText(line, &to);
+                    if (query->regex ? query->match(from, to) : logFind(from, to, query->text) != NULL) {
+                        matches.push_back(line);
+                    }
+                }
+                continue;
+            }
+            // the text of the whole block at once, the search text has no
+            // newline so what is found is within a line
+            const char * p = base + lineOffsets[line];
+            const char * stop = (blockEnd < end) ? base + lineOffsets[blockEnd] : linesBuffer.end();
+            while ((p = logFind(p, stop, query->text))) {
+                while (line + 1 < blockEnd && base + lineOffsets[line + 1] <= p) {
+                    line++;
+                }
+                matches.push_back(line++);
+                if (line >= blockEnd) {
+                    break;
+                }
+                p = base + lineOffsets[line];
+            }
+        }
+        searched = segmentEnd;
+        if (_budget > 0.0 && launcherTime() - start > _budget) {
+            break;
+        }
+    }
+    searchTime += (launcherTime() - start) * 1e3;
+}
+
+void ChildData::endSearch(void) {
+    delete query;
+    query = NULL;
+}
+
+// scroll to the next or previous line found
+void ChildData::nextMatch(int _step) {
+    if (matches.empty()) {
+        return;
+    }
+    if (currentMatch < 0) {
+        currentMatch = (_step > 0) ? 0 : matches.size() - 1;
+    } else {
+        currentMatch = (currentMatch + _step + matches.size()) % matches.size();
+    }
+    jumpLine = matches[currentMatch];
+    autoScroll = false;
+}
+
+void ChildData::drawSearch(void) {
+    ImGui::PushItemWidth(200);
+    if (ImGui::InputTextWithHint("##search", "search", searchText, IM_ARRAYSIZE(searchText))) {
+        search();
+    }
+    bool enter = ImGui::IsItemDeactivated() && ImGui::IsKeyPressed(ImGui::GetKeyIndex(ImGuiKey_Enter));
+    ImGui::PopItemWidth();
+    ImGui::SameLine();
+    if (ImGui::Checkbox("regex", &searchRegex)) {
+        search();
+    }
+    // some of a long search every frame, and the lines read since
+    updateSearch(0.01);
+    ImGui::SameLine();
+    if (ImGui::ArrowButton("##previous", ImGuiDir_Up)) {
+        nextMatch(-1);
+    }
+    ImGui::SameLine();
+    if (ImGui::ArrowButton("##next", ImGuiDir_Down) || enter) {
+        nextMatch(1);
+    }
+    ImGui::SameLine();
+    if (strlen(searchText) && ! query) {
+        ImGui::TextDisabled("not a valid regex");
+    } else if (query) {
+        const char * more = (searched < (size_t)lineOffsets.Size) ? "+" : "";
+        if (currentMatch >= 0) {
+            ImGui::Text("%d of %zu%s, %.1f ms", currentMatch + 1, matches.size(), more, searchTime);
+        } else {
+            ImGui::Text("%zu%s found, %.1f ms", matches.size(), more, searchTime);
+        }
+    }
+    ImGui::SameLine();
+    ImGui::TextDisabled("index %zu kB", searchIndex.bytes() / 1024);
+}
@@ -0,0 +1,88 @@
+#include "launcher.h"
+
+#include <stdio.h>
+#include <errno.h>
+
+// severity patterns, one per line:
+//   severity pattern
+// for example:
+//   error sevr=major
+//   warning asynTimeout
+// the pattern is the rest of the line, case does not matter; without the
+// file the patterns below are used
+
+static const char * severityNames[] = { "none", "warning", "error" };
+
+static const struct {
+    int severity;
+    const char * pattern;
+} defaultPatterns[] = {
+    // errlogSevPrintf()
+    { SEVERITY_WARNING, "sevr=minor" },
+    { SEVERITY_ERROR,   "sevr=major" },
+    { SEVERITY_ERROR,   "sevr=fatal" },
+    // asynStatus names, as asynPrint() and the drivers show them
+    { SEVERITY_WARNING, "asynTimeout" },
+    { SEVERITY_WARNING, "asynOverflow" },
+    { SEVERITY_ERROR,   "asynError" },
+    { SEVERITY_ERROR,   "asynDisconnected" },
+    { SEVERITY_ERROR,   "asynDisabled" },
+    { SEVERITY_WARNING, "warning" },
+    { SEVERITY_WARNING, "timeout" },
+    { SEVERITY_WARNING, "timed out" },
+    { SEVERITY_ERROR,   "error" },
+    { SEVERITY_ERROR,   "fatal" },
+    { SEVERITY_ERROR,   "failed" },
+    { SEVERITY_ERROR,   "exception" },
+    { SEVERITY_ERROR,   "segmentation fault" },
+    { SEVERITY_ERROR,   "not responding" },
+};
+
+// $XDG_CONFIG_HOME/gen2oll/severity or ~/.config/gen2oll/severity
+static bool severityPath(char * _path, size_t _size) {
+    char dir[512];
+    if (! launcherUserDir("XDG_CONFIG_HOME", ".config", dir, sizeof(dir), false)) {
+        return false;
+    }
+    snprintf(_path, _size, "%s/severity", dir);
+    return true;
+}
+
+bool IocList::loadSeverity(void) {
+    severity.clear();
+    char path[1024];
+    FILE * fp = NULL;
+    if (severityPath(path, sizeof(path))) {
+        fp = fopen(path, "r");
+    }
+    if (! fp) {
+        D("no severity patterns configured, using the defaults\n");
+        for (size_t n = 0; n < IM_ARRAYSIZE(defaultPatterns); n++) {
+            severity.add(defaultPatterns[n].pattern, defaultPatterns[n].severity);
+        }
+        severity.build();
+        return false;
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp)) {
+        char name[16];
+        char pattern[512];
+        if (line[0] == '#' || sscanf(line, "%15s %511[^\n]", name, pattern) != 2) {
+            continue;
+        }
+        int n = SEVERITY_WARNING;
+        while (n < IM_ARRAYSIZE(severityNames) && strcmp(name, severityNames[n]) != 0) {
+            n++;
+        }
+        if (n == IM_ARRAYSIZE(severityNames)) {
+            E("unknown severity %s for pattern %s\n", name, pattern);
+            continue;
+        }
+        severity.add(pattern, n);
+    }
+    fclose(fp);
+    severity.build();
+    D("loaded %zu severity patterns from %s\n", severity.patterns.size(), path);
+    return true;
+}
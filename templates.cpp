@@ -0,0 +1,274 @@
+#include "launcher.h"
+
+#include <stdio.h>
+
+static inline void putVarint(std::vector<unsigned char> & _out, size_t _value) {
+    while (_value >= 0x80) {
+        _out.push_back((_value & 0x7f) | 0x80);
+        _value >>= 7;
+    }
+    _out.push_back(_value);
+}
+
+static inline size_t getVarint(const unsigned char *& _p) {
+    size_t value = 0;
+    for (int shift = 0; ; shift += 7) {
+        value |= (size_t)(*_p & 0x7f) << shift;
+        if (! (*_p++ & 0x80)) {
+            return value;
+        }
+    }
+}
+
+static inline bool hasDigit(const char * _p, size_t _length) {
+    for (size_t n = 0; n < _length; n++) {
+        if (_p[n] >= '0' && _p[n] <= '9') {
+            return true;
+        }
+    }
+    return false;
+}
+
+static inline bool sameToken(const std::string & _token, const std::pair<const char *, size_t> & _split) {
+    return _token.size() == _split.second && memcmp(_token.data(), _split.first, _split.second) == 0;
+}
+
+// the line goes with the closest template of its group, or starts a new
+// cluster; then it is packed as:
+//   template number
+//   for every wildcard: 0, the length and the text; or the number of the
+//   value plus 1, if the wildcard took the same value before
+void LogTemplates::add(const char * _line, size_t _length) {
+    split.clear();
+    const char * token = _line;
+    const char * end = _line + _length;
+    for (const char * p = _line; ; p++) {
+        if (p == end || *p == ' ') {
+            split.push_back(std::make_pair(token, p - token));
+            if (p == end) {
+                break;
+            }
+            token = p + 1;
+        }
+    }
+
+    // most lines start with a time, the tokens with digits are left out of
+    // the key
+    std::string key = std::to_string(split.size());
+    for (size_t n = 0, used = 0; n < split.size() && used < 2; n++) {
+        if (! hasDigit(split[n].first, split[n].second)) {
+            key += '\x1f';
+            key.append(split[n].first, split[n].second);
+            used++;
+        }
+    }
+    std::vector<int> & group = groups[key];
+
+    int best = -1;
+    double bestSimilarity = -1.0;
+    for (size_t n = 0; n < group.size(); n++) {
+        LogTemplate & candidate = templates[clusterTemplate[group[n]]];
+        size_t fixed = 0, same = 0;
+        for (size_t i = 0; i < split.size(); i++) {
+            if (! candidate.wild[i]) {
+                fixed++;
+                same += sameToken(candidate.tokens[i], split[i]);
+            }
+        }
+        double similarity = fixed ? (double)same / fixed : 1.0;
+        if (similarity > bestSimilarity) {
+            best = group[n];
+            bestSimilarity = similarity;
+        }
+    }
+
+    int id;
+    if (best >= 0 && bestSimilarity >= LOG_TEMPLATE_SIMILARITY) {
+        id = clusterTemplate[best];
+        if (bestSimilarity < 1.0) {
+            // the tokens that differ become wildcards, in a new template so
+            // that the lines packed with the old one stay as they are
+            LogTemplate wider = templates[id];
+            for (size_t i = 0; i < split.size(); i++) {
+                if (! wider.wild[i] && ! sameToken(wider.tokens[i], split[i])) {
+                    wider.wild[i] = true;
+                    wider.tokens[i].clear();
+                }
+            }
+            templates.push_back(wider);
+            id = templates.size() - 1;
+            clusterTemplate[best] = id;
+        }
+        clusterLines[best]++;
+    } else {
+        LogTemplate fresh;
+        fresh.cluster = clusterTemplate.size();
+        for (size_t i = 0; i < split.size(); i++) {
+            bool wild = hasDigit(split[i].first, split[i].second);
+            fresh.tokens.push_back(wild ? std::string() : std::string(split[i].first, split[i].second));
+            fresh.wild.push_back(wild);
+        }
+        fresh.values.resize(split.size());
+        fresh.valueIds.resize(split.size());
+        templates.push_back(fresh);
+        id = templates.size() - 1;
+        group.push_back(fresh.cluster);
+        clusterTemplate.push_back(id);
+        clusterLines.push_back(1);
+    }
+
+    LogTemplate & t = templates[id];
+    putVarint(packed, id);
+    for (size_t i = 0; i < split.size(); i++) {
+        if (! t.wild[i]) {
+            continue;
+        }
+        std::string value(split[i].first, split[i].second);
+        auto it = t.valueIds[i].find(value);
+        if (it != t.valueIds[i].end()) {
+            putVarint(packed, it->second + 1);
+            continue;
+        }
+        putVarint(packed, 0);
+        putVarint(packed, value.size());
+        packed.insert(packed.end(), value.begin(), value.end());
+        if (t.values[i].size() < LOG_TEMPLATE_VALUES) {
+            t.valueIds[i][value] = t.values[i].size();
+            t.values[i].push_back(value);
+        }
+    }
+}
+
+// the line packed at _offset, back to text
+void LogTemplates::text(size_t _offset, std::string & _text) {
+    const unsigned char * p = &packed[_offset];
+    LogTemplate & t = templates[getVarint(p)];
+    _text.clear();
+    for (size_t i = 0; i < t.tokens.size(); i++) {
+        if (i) {
+            _text += ' ';
+        }
+        if (! t.wild[i]) {
+            _text += t.tokens[i];
+            continue;
+        }
+        size_t code = getVarint(p);
+        if (code) {
+            _text += t.values[i][code - 1];
+        } else {
+            size_t length = getVarint(p);
+            _text.append((const char *)p, length);
+            p += length;
+        }
+    }
+}
+
+int LogTemplates::cluster(size_t _offset) {
+    const unsigned char * p = &packed[_offset];
+    return templates[getVarint(p)].cluster;
+}
+
+// the latest template of a cluster, <*> for the wildcards
+std::string LogTemplates::pattern(int _cluster) {
+    LogTemplate & t = templates[clusterTemplate[_cluster]];
+    std::string text;
+    for (size_t i = 0; i < t.tokens.size(); i++) {
+        text += i ? " " : "";
+        text += t.wild[i] ? "<*>" : t.tokens[i];
+    }
+    return text;
+}
+
+// roughly, the strings and tables are counted by their contents
+size_t LogTemplates::bytes(void) {
+    size_t size = packed.size();
+    for (size_t n = 0; n < templates.size(); n++) {
+        LogTemplate & t = templates[n];
+        for (size_t i = 0; i < t.tokens.size(); i++) {
+            size += t.tokens[i].size() + 1;
+            for (size_t v = 0; v < t.values[i].size(); v++) {
+                size += 2 * t.values[i][v].size() + sizeof(int);
+            }
+        }
+    }
+    return size;
+}
+
+// the lines are packed or unpacked, the rest stays as it is
+void ChildData::setCompact(bool _compact) {
+    if (_compact == compact) {
+        return;
+    }
+    ImVector<int> offsets;
+    if (_compact) {
+        templates.clear();
+        for (int line = 0; line < lineOffsets.Size; line++) {
+            const char * end;
+            const char * start = lineText(line, &end);
+            offsets.push_back(templates.packed.size());
+            templates.add(start, end - start);
+        }
+        linesBuffer.Buf.clear();
+    } else {
+        ImGuiTextBuffer buffer;
+        for (int line = 0; line < lineOffsets.Size; line++) {
+            const char * end;
+            const char * start = lineText(line, &end);
+            offsets.push_back(buffer.size());
+            buffer.append(start, end);
+            buffer.append("\n");
+        }
+        linesBuffer.Buf.swap(buffer.Buf);
+        templates.clear();
+        filterCluster = -1;
+    }
+    lineOffsets.swap(offsets);
+    compact = _compact;
+    filter();
+}
+
+// the clusters by their line count, a click shows only the lines of one
+void ChildData::drawTemplates(void) {
+    if (ImGui::Button("templates")) {
+        ImGui::OpenPopup("templates");
+    }
+    if (filterCluster >= 0) {
+        ImGui::SameLine();
+        if (ImGui::SmallButton("all lines")) {
+            filterCluster = -1;
+            filter();
+        }
+    }
+    if (! ImGui::BeginPopup("templates")) {
+        return;
+    }
+    std::vector<int> order(templates.clusterLines.size());
+    for (size_t n = 0; n < order.size(); n++) {
+        order[n] = n;
+    }
+    std::sort(order.begin(), order.end(), [this](int a, int b) {
+        return templates.clusterLines[a] > templates.clusterLines[b];
+    });
+    ImGui::Text("%zu templates of %d lines, %zu kB", order.size(), lineOffsets.Size, templates.bytes() / 1024);
+    ImGui::Separator();
+    ImGui::BeginChild("clusters", ImVec2(800, std::min(order.size(), (size_t)20) * ImGui::GetTextLineHeightWithSpacing()));
+    ImGuiListClipper clipper;
+    clipper.Begin(order.size());
+    while (clipper.Step()) {
+        for (int row = clipper.DisplayStart; row < clipper.DisplayEnd; row++) {
+            int cluster = order[row];
+            char label[32];
+            snprintf(label, sizeof(label), "%8zu##%d", templates.clusterLines[cluster], cluster);
+            if (ImGui::Selectable(label, filterCluster == cluster)) {
+                filterCluster = cluster;
+                filter();
+            }
+            ImGui::SameLine();
+            std::string pattern = templates.pattern(cluster);
+            ImGui::TextUnformatted(pattern.c_str(), pattern.c_str() + pattern.size());
+        }
+    }
+    clipper.End();
+    ImGui::EndChild();
+    ImGui::EndPopup();
+}
@@ -0,0 +1,241 @@
+#include "launcher.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+void IocTimeline::add(Ioc * _ioc, ChildData * _data) {
+    if (find(_data) >= 0) {
+        return;
+    }
+    _data->inTimeline = true;
+    sources.push_back(TimelineSource{_ioc, _data});
+    valid = false;
+}
+
+void IocTimeline::remove(ChildData * _data) {
+    int n = find(_data);
+    if (n < 0) {
+        return;
+    }
+    _data->inTimeline = false;
+    sources.erase(sources.begin() + n);
+    valid = false;
+}
+
+// the IOC is going away
+void IocTimeline::remove(Ioc * _ioc) {
+    remove(&_ioc->childStdout);
+    remove(&_ioc->childStderr);
+}
+
+// pick up the checkboxes of an IOC window
+void IocTimeline::sync(Ioc * _ioc) {
+    ChildData * streams[2] = { &_ioc->childStdout, &_ioc->childStderr };
+    for (int n = 0; n < 2; n++) {
+        bool shown = find(streams[n]) >= 0;
+        if (streams[n]->inTimeline && ! shown) {
+            add(_ioc, streams[n]);
+            open = true;
+        } else if (! streams[n]->inTimeline && shown) {
+            remove(streams[n]);
+        }
+    }
+}
+
+// rows read before _mono
+size_t IocTimeline::before(uint64_t _mono) {
+    size_t rows = 0;
+    for (size_t n = 0; n < sources.size(); n++) {
+        rows += std::min(sources[n].data->stamps.find(_mono), counts[n]);
+    }
+    return rows;
+}
+
+// cursors at merged row _row: the last time T with fewer rows before it
+// than _row, then the rows at T are taken stream by stream
+void IocTimeline::seek(size_t _row) {
+    PROFILE_ZONE("IocTimeline::seek");
+    cursors.assign(sources.size(), 0);
+    cursorRow = _row;
+    uint64_t lo = UINT64_MAX, hi = 0;
+    for (size_t n = 0; n < sources.size(); n++) {
+        if (counts[n]) {
+            LogStamps & stamps = sources[n].data->stamps;
+            lo = std::min(lo, stamps.mono(0));
+            hi = std::max(hi, stamps.mono(counts[n] - 1));
+        }
+    }
+    if (lo > hi) {
+        return;
+    }
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo + 1) / 2;
+        if (before(mid) <= _row) {
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    size_t rows = 0;
+    for (size_t n = 0; n < sources.size(); n++) {
+        cursors[n] = std::min(sources[n].data->stamps.find(lo), counts[n]);
+        rows += cursors[n];
+    }
+    size_t left = _row - rows;
+    for (size_t n = 0; n < sources.size() && left; n++) {
+        size_t end = std::min(sources[n].data->stamps.find(lo + 1), counts[n]);
+        size_t take = std::min(left, end - cursors[n]);
+        cursors[n] += take;
+        left -= take;
+    }
+}
+
+// stream with the next row, -1 at the end
+int IocTimeline::next(std::vector<size_t> & _cursors) {
+    int best = -1;
+    uint64_t bestMono = 0;
+    for (size_t n = 0; n < sources.size(); n++) {
+        if (_cursors[n] >= counts[n]) {
+            continue;
+        }
+        uint64_t mono = sources[n].data->stamps.mono(_cursors[n]);
+        if (best < 0 || mono < bestMono) {
+            best = n;
+            bestMono = mono;
+        }
+    }
+    return best;
+}
+
+void IocTimeline::step(std::vector<size_t> & _cursors, size_t _rows) {
+    for (size_t row = 0; row < _rows; row++) {
+        int n = next(_cursors);
+        if (n < 0) {
+            return;
+        }
+        _cursors[n]++;
+    }
+}
+
+void IocTimeline::draw(void) {
+    PROFILE_ZONE("IocTimeline::draw");
+    ImGui::SetNextWindowSize(ImVec2(900, 600), ImGuiCond_FirstUseEver);
+    // the rows scroll on their own, see below
+    if (! ImGui::Begin("Timeline", &open, ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse)) {
+        ImGui::End();
+        return;
+    }
+
+    // lines that come in while drawing wait for the next frame
+    size_t total = 0;
+    counts.resize(sources.size());
+    for (size_t n = 0; n < sources.size(); n++) {
+        size_t count = sources[n].data->stamps.count;
+        if (count < counts[n]) {
+            valid = false;
+        }
+        counts[n] = count;
+        total += count;
+    }
+
+    TimelineSource * removed = NULL;
+    for (size_t n = 0; n < sources.size(); n++) {
+        TimelineSource & source = sources[n];
+        ImGui::PushID(source.data);
+        if (n) {
+            ImGui::SameLine();
+        }
+        if (ImGui::SmallButton("x")) {
+            removed = &source;
+        }
+        ImGui::SameLine();
+        ImGui::Text("%s %s", source.ioc->deviceName, source.data->name);
+        ImGui::PopID();
+    }
+    if (sources.empty()) {
+        ImGui::TextDisabled("pick the streams in the IOC windows");
+    }
+    ImGui::Checkbox("follow", &follow);
+    ImGui::SameLine();
+    ImGui::Checkbox("time", &showStamps);
+    ImGui::SameLine();
+    ImGui::Text("%zu lines", total);
+    ImGui::Separator();
+
+    // ImGuiListClipper positions in float pixels, too coarse for tens of
+    // millions of rows, so the rows are scrolled here by index
+    float lineHeight = ImGui::GetTextLineHeightWithSpacing();
+    float barWidth = ImGui::GetStyle().ScrollbarSize;
+    ImVec2 size = ImGui::GetContentRegionAvail();
+    size_t visible = std::max(1.0f, size.y / lineHeight);
+    size_t maxTop = (total > visible) ? total - visible : 0;
+    ImGui::BeginChild("timelinerows", ImVec2(size.x - barWidth - ImGui::GetStyle().ItemSpacing.x, size.y), false,
+        ImGuiWindowFlags_NoScrollbar | ImGuiWindowFlags_NoScrollWithMouse | ImGuiWindowFlags_HorizontalScrollbar);
+    if (ImGui::IsWindowHovered() && ImGui::GetIO().MouseWheel != 0.0f) {
+        double rows = -ImGui::GetIO().MouseWheel * 3.0;
+        top = (rows < 0 && (size_t)-rows > top) ? 0 : std::min((size_t)(top + rows), maxTop);
+        follow = top >= maxTop;
+    }
+    if (follow || top > maxTop) {
+        top = maxTop;
+    }
+
+    if (! valid || top < cursorRow || top - cursorRow > TIMELINE_STEP_ROWS) {
+        seek(top);
+        valid = true;
+    } else if (top > cursorRow) {
+        step(cursors, top - cursorRow);
+        cursorRow = top;
+    }
+
+    std::vector<size_t> rowCursors = cursors;
+    for (size_t row = 0; row < visible; row++) {
+        int n = next(rowCursors);
+        if (n < 0) {
+            break;
+        }
+        TimelineSource & source = sources[n];
+        ChildData * data = source.data;
+        size_t line = rowCursors[n]++;
+        if (showStamps) {
+            int64_t wall = data->stamps.mono(line) + data->stamps.wallOffset(line);
+            time_t sec = wall / 1000000;
+            struct tm tm;
+            localtime_r(&sec, &tm);
+            ImGui::TextDisabled("%02d:%02d:%02d.%03d", tm.tm_hour, tm.tm_min, tm.tm_sec, (int)(wall % 1000000 / 1000));
+            ImGui::SameLine();
+        }
+        bool error = (data == &source.ioc->childStderr);
+        ImVec4 color = error ? ImVec4(1.0f, 0.4f, 0.4f, 1.0f) : ImVec4(0.6f, 0.8f, 1.0f, 1.0f);
+        ImGui::TextColored(color, "%-12s", source.ioc->deviceName);
+        if (ImGui::IsItemClicked()) {
+            source.ioc->open = true;
+        }
+        ImGui::SameLine();
+        if (error) {
+            ImGui::PushStyleColor(ImGuiCol_Text, color);
+        }
+        data->drawText(line);
+        if (error) {
+            ImGui::PopStyleColor();
+        }
+    }
+    for (size_t n = 0; n < sources.size(); n++) {
+        sources[n].data->drawRepeats();
+    }
+    ImGui::EndChild();
+
+    // top row at the top of the bar
+    ImGui::SameLine();
+    size_t zero = 0;
+    if (ImGui::VSliderScalar("##timelinescroll", ImVec2(barWidth, size.y), ImGuiDataType_U64, &top, &maxTop, &zero, "")) {
+        follow = top >= maxTop;
+    }
+
+    ImGui::End();
+
+    if (removed) {
+        remove(removed->data);
+    }
+}
@@ -0,0 +1,99 @@
+#!/bin/bash
+#
+# Build a tree of fake stages the launcher can discover and start_ioc.sh
+# can launch, each instance running tools/fakeioc with its own load profile.
+#
+#   make -f Makefile.fakeioc
+#   tools/fake_stages.sh /tmp/fake 6 10
+#
+# then add /tmp/fake as an IOC root in the launcher. Note that start_ioc.sh
+# wants the 'bde' group and the 'ioc' user, and sudo to create them.
+
+set -e
+set -u
+
+if [[ $# -lt 1 ]]; then
+  echo "usage $(basename $0) <root> [stages] [instances per stage] [fakeioc]"
+  exit 1
+fi
+
+ROOT="$1"
+STAGES="${2:-6}"
+INSTANCES="${3:-10}"
+FAKEIOC="$(realpath ${4:-$(dirname $0)/fakeioc})"
+
+if [[ ! -x $FAKEIOC ]]; then
+  echo "$FAKEIOC not found, run 'make -f Makefile.fakeioc' first"
+  exit 1
+fi
+
+# load profiles, the instances take turns:
+#   name rate burst line_min line_max stderr_rate storm_period storm_lines prompt stdin_delay crash
+PROFILES=(
+  "quiet   1     1   40  120  0.01  0    0     1  0    0"
+  "chatty  200   1   40  160  0.1   0    0     1  0    0"
+  "bursty  100   500 40  400  0.1   0    0     1  0    0"
+  "storm   10    1   40  160  1     30   5000  1  0    0"
+  "crashy  20    1   40  160  0.5   0    0     1  0    0.01"
+  "slowsh  20    1   40  160  0.1   0    0     1  500  0"
+  "noprompt 50   10  20  1000 0.1   0    0     0  0    0"
+)
+
+for ((s = 0; s < STAGES; s++)); do
+  STAGE="$ROOT/fake-stage$s"
+  mkdir -p $STAGE/bin $STAGE/ioc
+  cp $FAKEIOC $STAGE/bin/fakeioc
+
+  cat << EOF > $STAGE/env.sh
+APP_NAME=fakeioc
+RECIPE_NAME=fake-stage$s
+BUILD_HOST=$(hostname)
+BUILD_USER=${USER:-$(id -un)}
+BUILD_DATETIME="$(date)"
+EOF
+
+  cat << EOF > $STAGE/ioc/st.cmd.in
+< envVars
+< instance.cmd
+
+epicsEnvSet("PREFIX", "\$(LOCATION):\$(DEVICE_NAME):")
+dbLoadRecords("\$(DB_DIR)/fake.template", "P=\$(PREFIX)")
+set_requestfile_path("\$(AUTOSAVE_DIR)")
+set_pass0_restoreFile("default_settings.sav")
+
+iocInit
+EOF
+
+  cat << EOF > $STAGE/ioc/default_settings.sav.in
+# save/restore V5.1	Automatically generated - DO NOT MODIFY - 201103-102105
+\$(PREFIX)cam1:AcquireTime 0.05
+\$(PREFIX)cam1:AcquirePeriod 0.1
+<END>
+EOF
+
+  for ((i = 0; i < INSTANCES; i++)); do
+    read NAME RATE BURST LINE_MIN LINE_MAX STDERR_RATE STORM_PERIOD STORM_LINES PROMPT STDIN_DELAY CRASH \
+      <<< "${PROFILES[$(( (s * INSTANCES + i) % ${#PROFILES[@]} ))]}"
+    INSTANCE="$STAGE/ioc/$NAME$i"
+    mkdir -p $INSTANCE
+    cat << EOF > $INSTANCE/instance.cmd
+epicsEnvSet("LOCATION", "FAKE$s")
+epicsEnvSet("DEVICE_NAME", "CAM$i")
+epicsEnvSet("CAMERA_NAME", "FAKE$s-$NAME-$i")
+
+epicsEnvSet("FAKE_RATE", "$RATE")
+epicsEnvSet("FAKE_BURST", "$BURST")
+epicsEnvSet("FAKE_LINE_MIN", "$LINE_MIN")
+epicsEnvSet("FAKE_LINE_MAX", "$LINE_MAX")
+epicsEnvSet("FAKE_STDERR_RATE", "$STDERR_RATE")
+epicsEnvSet("FAKE_STORM_PERIOD", "$STORM_PERIOD")
+epicsEnvSet("FAKE_STORM_LINES", "$STORM_LINES")
+epicsEnvSet("FAKE_PROMPT", "$PROMPT")
+epicsEnvSet("FAKE_STDIN_DELAY", "$STDIN_DELAY")
+epicsEnvSet("FAKE_CRASH", "$CRASH")
+epicsEnvSet("FAKE_PROBE", "1")
+EOF
+  done
+done
+
+echo "$STAGES stages with $INSTANCES instances each in $ROOT"
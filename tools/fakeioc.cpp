@@ -0,0 +1,302 @@
+// stand-in for an areaDetector IOC, for load testing the launcher with real
+// processes: runs the st.cmd it is given the way iocsh would (echoes the
+// lines, follows '< file' includes, sets epicsEnvSet() variables), then
+// keeps producing output as configured by these variables:
+//
+//   FAKE_RATE          stdout lines per second                     10
+//   FAKE_BURST         lines written at once                       1
+//   FAKE_LINE_MIN      shortest line                               40
+//   FAKE_LINE_MAX      longest line, most lines are short          160
+//   FAKE_STDERR_RATE   stderr lines per second                     0.1
+//   FAKE_STORM_PERIOD  seconds between stderr storms, 0 for none   0
+//   FAKE_STORM_LINES   stderr lines in a storm                     1000
+//   FAKE_PROMPT        print the iocsh prompt                      1
+//   FAKE_STDIN_DELAY   ms before reading the next command          0
+//   FAKE_CRASH         chance to crash in a given second           0
+//   FAKE_PROBE         latency marker lines per second, taking     0
+//                      turns on stdout and stderr
+//   FAKE_SEED          random seed, 0 to seed from the PID         0
+//
+//   fakeioc st.cmd
+
+#include "launcher.h"
+#include "macros.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <math.h>
+
+struct FakeConfig {
+    double rate;
+    int burst;
+    int lineMin;
+    int lineMax;
+    double stderrRate;
+    double stormPeriod;
+    int stormLines;
+    bool prompt;
+    int stdinDelay;
+    double crash;
+    double probe;
+    const char * device;
+};
+
+static double fakeValue(MacroTable & _macros, const char * _name, double _default) {
+    const char * value = _macros.get(_name);
+    if (! value) {
+        value = getenv(_name);
+    }
+    return (value && *value) ? atof(value) : _default;
+}
+
+// as iocsh does, every line is echoed before it is run
+static void runScript(const char * _path, const char * _cwd, int _depth) {
+    MappedFile file(_path);
+    if (! file.valid()) {
+        fprintf(stderr, "Can't open %s: %s\n", _path, strerror(file.error));
+        return;
+    }
+    const char * end = file.data + file.size;
+    for (const char * line = file.data; line < end; ) {
+        const char * eol = (const char *)memchr(line, '\n', end - line);
+        if (! eol) {
+            eol = end;
+        }
+        printf("%.*s\n", (int)(eol - line), line);
+        const char * p = line;
+        while (p < eol && (*p == ' ' || *p == '\t')) {
+            p++;
+        }
+        if (p < eol && *p == '<' && _depth < 16) {
+            p++;
+            while (p < eol && (*p == ' ' || *p == '\t')) {
+                p++;
+            }
+            char include[1024];
+            if (*p == '/') {
+                snprintf(include, sizeof(include), "%.*s", (int)(eol - p), p);
+            } else {
+                snprintf(include, sizeof(include), "%s/%.*s", _cwd, (int)(eol - p), p);
+            }
+            runScript(include, _cwd, _depth + 1);
+        } else if (eol - p >= 7 && strncmp(p, "iocInit", 7) == 0) {
+            printf("Starting iocInit\n");
+            printf("############################################################################\n");
+            printf("## EPICS R7.0.4\n");
+            printf("## Rev. 2020-11-03T10:21+0100\n");
+            printf("############################################################################\n");
+            printf("iocRun: All initialization complete\n");
+        }
+        line = eol + 1;
+    }
+}
+
+// mostly short lines with a long tail, like real IOC output
+static void fakeLine(FakeConfig & _config, const char * _kind, char * _line, size_t _size) {
+    static const char * words[] = {
+        "acquire", "period", "exposure", "callback", "array", "bytes", "mean",
+        "sigma", "timeout", "asynPortDriver", "frame", "dropped", "queue",
+    };
+    double r = drand48();
+    size_t length = _config.lineMin + (_config.lineMax - _config.lineMin) * r * r * r;
+    if (length >= _size) {
+        length = _size - 1;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    struct tm tm;
+    localtime_r(&ts.tv_sec, &tm);
+    size_t len = strftime(_line, _size, "%Y/%m/%d %H:%M:%S", &tm);
+    len += snprintf(_line + len, _size - len, ".%03ld %s:%s:", ts.tv_nsec / 1000000, _config.device, _kind);
+    while (len < length) {
+        len += snprintf(_line + len, _size - len, " %s", words[lrand48() % IM_ARRAYSIZE(words)]);
+    }
+    len = (len < length) ? len : length;
+    _line[len] = '\n';
+    _line[len + 1] = '\0';
+}
+
+// write all of _data, the launcher may be slow to drain the pipe
+static void writeAll(int _fd, const char * _data, size_t _size) {
+    while (_size) {
+        ssize_t n = write(_fd, _data, _size);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            // the launcher is gone
+            exit(1);
+        }
+        _data += n;
+        _size -= n;
+    }
+}
+
+static void writeLines(FakeConfig & _config, int _fd, const char * _kind, int _count) {
+    std::string out;
+    char line[1024];
+    for (int n = 0; n < _count; n++) {
+        fakeLine(_config, _kind, line, sizeof(line) - 1);
+        out += line;
+    }
+    writeAll(_fd, out.data(), out.size());
+}
+
+static void prompt(FakeConfig & _config) {
+    if (_config.prompt) {
+        writeAll(1, "epics> ", 7);
+    }
+}
+
+// the few commands one would type into a camera IOC shell
+static bool runCommand(FakeConfig & _config, char * _command) {
+    char * end = _command + strlen(_command);
+    while (end > _command && (end[-1] == '\n' || end[-1] == '\r' || end[-1] == ' ')) {
+        *--end = '\0';
+    }
+    char reply[1024];
+    if (strcmp(_command, "exit") == 0) {
+        return false;
+    } else if (strncmp(_command, "echo ", 5) == 0) {
+        snprintf(reply, sizeof(reply), "%s\n", _command + 5);
+        writeAll(1, reply, strlen(reply));
+    } else if (strcmp(_command, "dbl") == 0) {
+        static const char * records[] = { "cam1:Acquire", "cam1:AcquireTime", "image1:ArrayData", "Stats1:MeanValue_RBV" };
+        std::string out;
+        for (size_t n = 0; n < IM_ARRAYSIZE(records); n++) {
+            snprintf(reply, sizeof(reply), "%s:%s\n", _config.device, records[n]);
+            out += reply;
+        }
+        writeAll(1, out.data(), out.size());
+    } else if (strlen(_command)) {
+        snprintf(reply, sizeof(reply), "Command %s not found.\n", _command);
+        writeAll(1, reply, strlen(reply));
+    }
+    prompt(_config);
+    return true;
+}
+
+int main(int argc, char ** argv) {
+    if (argc < 2) {
+        fprintf(stderr, "usage: %s st.cmd\n", argv[0]);
+        return 1;
+    }
+    char cwd[1024];
+    if (! getcwd(cwd, sizeof(cwd))) {
+        strcpy(cwd, ".");
+    }
+
+    MacroEngine engine;
+    MacroTable macros;
+    engine.evaluate(argv[1], cwd, macros, 0);
+    runScript(argv[1], cwd, 0);
+    fflush(stdout);
+
+    FakeConfig config;
+    config.rate = fakeValue(macros, "FAKE_RATE", 10);
+    config.burst = std::max(1.0, fakeValue(macros, "FAKE_BURST", 1));
+    config.lineMin = fakeValue(macros, "FAKE_LINE_MIN", 40);
+    config.lineMax = std::max((double)config.lineMin, fakeValue(macros, "FAKE_LINE_MAX", 160));
+    config.stderrRate = fakeValue(macros, "FAKE_STDERR_RATE", 0.1);
+    config.stormPeriod = fakeValue(macros, "FAKE_STORM_PERIOD", 0);
+    config.stormLines = fakeValue(macros, "FAKE_STORM_LINES", 1000);
+    config.prompt = fakeValue(macros, "FAKE_PROMPT", 1) != 0;
+    config.stdinDelay = fakeValue(macros, "FAKE_STDIN_DELAY", 0);
+    config.crash = fakeValue(macros, "FAKE_CRASH", 0);
+    config.probe = fakeValue(macros, "FAKE_PROBE", 0);
+    config.device = macros.get(INSTANCE_CAMERA_NAME);
+    if (! config.device) {
+        config.device = "FAKE";
+    }
+    long seed = fakeValue(macros, "FAKE_SEED", 0);
+    srand48(seed ? seed : getpid());
+
+    // the launcher reads the output, not a terminal
+    signal(SIGPIPE, SIG_IGN);
+    prompt(config);
+
+    double now = launcherTime();
+    double nextOut = config.rate > 0 ? now : INFINITY;
+    double nextErr = config.stderrRate > 0 ? now : INFINITY;
+    double nextStorm = config.stormPeriod > 0 ? now + config.stormPeriod : INFINITY;
+    double nextCrash = now + 1.0;
+    double nextProbe = config.probe > 0 ? now : INFINITY;
+    int probes = 0;
+    char command[1024];
+    size_t commandLen = 0;
+    for (;;) {
+        now = launcherTime();
+        if (now >= nextOut) {
+            writeLines(config, 1, "cam1", config.burst);
+            // exponential gaps, so the rate is an average
+            nextOut += -log(1.0 - drand48()) * config.burst / config.rate;
+            if (nextOut < now - 1.0) {
+                // the pipe was full for a while, do not catch up all at once
+                nextOut = now;
+            }
+        }
+        if (now >= nextErr) {
+            writeLines(config, 2, "error", 1);
+            nextErr += -log(1.0 - drand48()) / config.stderrRate;
+        }
+        if (now >= nextStorm) {
+            writeLines(config, 2, "storm", config.stormLines);
+            nextStorm = now + config.stormPeriod;
+        }
+        if (now >= nextCrash) {
+            if (drand48() < config.crash) {
+                fprintf(stderr, "%s: fake crash\n", config.device);
+                raise(SIGSEGV);
+            }
+            nextCrash += 1.0;
+        }
+
+        if (now >= nextProbe) {
+            char marker[64];
+            snprintf(marker, sizeof(marker), "%s:probe: %s%llu\n", config.device, LATENCY_MARKER, (unsigned long long)profilerNow());
+            writeAll(1 + probes++ % 2, marker, strlen(marker));
+            nextProbe += 1.0 / config.probe;
+        }
+
+        double next = std::min(std::min(nextOut, nextErr), std::min(nextStorm, nextCrash));
+        next = std::min(next, nextProbe);
+        int timeout = std::max(0.0, (next - launcherTime()) * 1e3);
+        struct pollfd fds;
+        fds.fd = 0;
+        fds.events = POLLIN;
+        fds.revents = 0;
+        if (poll(&fds, 1, timeout) <= 0) {
+            continue;
+        }
+        if (config.stdinDelay) {
+            // a busy IOC shell, commands pile up in the pipe
+            usleep(config.stdinDelay * 1000);
+        }
+        ssize_t n = read(0, command + commandLen, sizeof(command) - 1 - commandLen);
+        if (n <= 0) {
+            // stdin closed, the launcher is gone
+            return 0;
+        }
+        commandLen += n;
+        command[commandLen] = '\0';
+        char * start = command;
+        char * eol;
+        while ((eol = strchr(start, '\n'))) {
+            *eol = '\0';
+            if (! runCommand(config, start)) {
+                return 0;
+            }
+            start = eol + 1;
+        }
+        commandLen = strlen(start);
+        memmove(command, start, commandLen + 1);
+        if (commandLen == sizeof(command) - 1) {
+            // no newline in sight, drop it
+            commandLen = 0;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,262 @@
+#include "launcher.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <math.h>
+#include <sys/wait.h>
+
+// triggers, one per line:
+//   actions holdoff pattern [=> command]
+// actions are highlight, notify, restart and command joined by commas, or
+// none; for example:
+//   highlight,notify 60 camera disconnected
+//   restart 300 Out of memory
+//   command 10 asynTimeout => dbpf $(PREFIX)cam1:Acquire 0
+
+static const char * actionNames[] = { "highlight", "notify", "restart", "command" };
+
+// $XDG_CONFIG_HOME/gen2oll/triggers or ~/.config/gen2oll/triggers
+static bool triggersPath(char * _path, size_t _size, bool _create) {
+    char dir[512];
+    if (! launcherUserDir("XDG_CONFIG_HOME", ".config", dir, sizeof(dir), _create)) {
+        return false;
+    }
+    snprintf(_path, _size, "%s/triggers", dir);
+    return true;
+}
+
+// one automaton for all the triggers
+void IocList::buildTriggers(void) {
+    triggerMatcher.clear();
+    for (size_t n = 0; n < triggers.size(); n++) {
+        triggerMatcher.add(triggers[n].pattern, n + 1);
+    }
+    triggerMatcher.build();
+    // the trigger numbers may have changed
+    for (size_t n = 0; n < list.size(); n++) {
+        list[n]->triggerTimes.clear();
+    }
+}
+
+bool IocList::loadTriggers(void) {
+    triggers.clear();
+    char path[1024];
+    FILE * fp = NULL;
+    if (triggersPath(path, sizeof(path), false)) {
+        fp = fopen(path, "r");
+    }
+    if (! fp) {
+        D("no triggers configured\n");
+        buildTriggers();
+        return false;
+    }
+
+    char line[1024];
+    while (fgets(line, sizeof(line), fp)) {
+        char actions[64];
+        float holdoff;
+        char rest[512];
+        if (line[0] == '#' || sscanf(line, "%63s %f %511[^\n]", actions, &holdoff, rest) != 3) {
+            continue;
+        }
+        Trigger trigger;
+        trigger.actions = 0;
+        trigger.holdoff = holdoff;
+        for (char * name = strtok(actions, ","); name; name = strtok(NULL, ",")) {
+            size_t n = 0;
+            while (n < IM_ARRAYSIZE(actionNames) && strcmp(name, actionNames[n]) != 0) {
+                n++;
+            }
+            if (n < IM_ARRAYSIZE(actionNames)) {
+                trigger.actions |= 1 << n;
+            } else if (strcmp(name, "none") != 0) {
+                E("unknown trigger action %s\n", name);
+            }
+        }
+        char * arrow = strstr(rest, " => ");
+        if (arrow) {
+            *arrow = '\0';
+            snprintf(trigger.command, sizeof(trigger.command), "%s", arrow + 4);
+        }
+        snprintf(trigger.pattern, sizeof(trigger.pattern), "%.*s", (int)sizeof(trigger.pattern) - 1, rest);
+        triggers.push_back(trigger);
+    }
+    fclose(fp);
+    buildTriggers();
+    D("loaded %zu triggers from %s\n", triggers.size(), path);
+    return true;
+}
+
+bool IocList::saveTriggers(void) {
+    char path[1024];
+    if (! triggersPath(path, sizeof(path), true)) {
+        return false;
+    }
+    FILE * fp = fopen(path, "w");
+    if (! fp) {
+        E("fopen() %s failed %s\n", path, strerror(errno));
+        return false;
+    }
+    fprintf(fp, "# actions holdoff pattern [=> command]\n");
+    for (size_t n = 0; n < triggers.size(); n++) {
+        Trigger & trigger = triggers[n];
+        if (! strlen(trigger.pattern)) {
+            continue;
+        }
+        std::string actions;
+        for (size_t i = 0; i < IM_ARRAYSIZE(actionNames); i++) {
+            if (trigger.actions & (1 << i)) {
+                actions += actions.size() ? "," : "";
+                actions += actionNames[i];
+            }
+        }
+        fprintf(fp, "%s %g %s", actions.size() ? actions.c_str() : "none", trigger.holdoff, trigger.pattern);
+        if (strlen(trigger.command)) {
+            fprintf(fp, " => %s", trigger.command);
+        }
+        fprintf(fp, "\n");
+    }
+    if (fclose(fp) != 0) {
+        E("writing %s failed %s\n", path, strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// desktop notification; notify-send is left to init, so there is no child
+// to wait for
+static void notify(const char * _summary, const char * _body) {
+    pid_t p = fork();
+    if (p == 0) {
+        if (fork() == 0) {
+            execlp("notify-send", "notify-send", "-a", "gen2oll", _summary, _body, (char *) NULL);
+            _exit(1);
+        }
+        _exit(0);
+    }
+    if (p < 0) {
+        E("fork() failed %s\n", strerror(errno));
+        return;
+    }
+    waitpid(p, NULL, 0);
+}
+
+// run the actions of the triggers found in the lines just read
+void IocList::fireTriggers(Ioc * _ioc) {
+    ChildData * streams[2] = { &_ioc->childStdout, &_ioc->childStderr };
+    bool restart = false;
+    double now = launcherTime();
+    for (int s = 0; s < 2; s++) {
+        ChildData * data = streams[s];
+        for (size_t n = 0; n < data->triggerHits.size(); n++) {
+            TriggerHit & hit = data->triggerHits[n];
+            if (hit.trigger >= (int)triggers.size() || (int)hit.line >= data->lineOffsets.Size) {
+                continue;
+            }
+            Trigger & trigger = triggers[hit.trigger];
+            const char * end;
+            const char * start = data->lineText(hit.line, &end);
+            trigger.fired++;
+            snprintf(trigger.last, sizeof(trigger.last), "%s: %.*s", _ioc->deviceName, (int)(end - start), start);
+            if ((trigger.actions & TRIGGER_HIGHLIGHT) && (data->highlightLines.empty() || data->highlightLines.back() != hit.line)) {
+                data->highlightLines.push_back(hit.line);
+            }
+
+            if (! (trigger.actions & ~TRIGGER_HIGHLIGHT)) {
+                continue;
+            }
+            if (_ioc->triggerTimes.size() < triggers.size()) {
+                _ioc->triggerTimes.resize(triggers.size(), -INFINITY);
+            }
+            if (now - _ioc->triggerTimes[hit.trigger] < trigger.holdoff) {
+                continue;
+            }
+            _ioc->triggerTimes[hit.trigger] = now;
+            D("trigger '%s' fired for %s\n", trigger.pattern, _ioc->deviceName);
+            PROFILE_INSTANT("trigger", trigger.pattern);
+            if (trigger.actions & TRIGGER_NOTIFY) {
+                char summary[160];
+                snprintf(summary, sizeof(summary), "%s: %s", _ioc->deviceName, trigger.pattern);
+                notify(summary, trigger.last);
+            }
+            if ((trigger.actions & TRIGGER_COMMAND) && strlen(trigger.command) && _ioc->started) {
+                if (! _ioc->macrosComplete) {
+                    _ioc->resolve();
+                }
+                std::vector<char> command;
+                if (_ioc->engine) {
+                    _ioc->engine->expand(trigger.command, strlen(trigger.command), _ioc->macros, command, 0);
+                } else {
+                    command.assign(trigger.command, trigger.command + strlen(trigger.command));
+                }
+                command.push_back('\0');
+                _ioc->sendCommand(command.data());
+            }
+            if (trigger.actions & TRIGGER_RESTART) {
+                restart = true;
+            }
+        }
+        data->triggerHits.clear();
+    }
+    if (restart) {
+        // starting clears the logs, the line stays in the trigger
+        _ioc->stop();
+        _ioc->start();
+    }
+}
+
+void IocList::drawTriggers(void) {
+    bool changed = false;
+    bool rebuild = false;
+    int removed = -1;
+    for (size_t n = 0; n < triggers.size(); n++) {
+        Trigger & trigger = triggers[n];
+        ImGui::PushID(n);
+        ImGui::PushItemWidth(200);
+        ImGui::InputTextWithHint("##pattern", "text to look for", trigger.pattern, IM_ARRAYSIZE(trigger.pattern));
+        rebuild |= ImGui::IsItemDeactivatedAfterEdit();
+        ImGui::PopItemWidth();
+        for (size_t i = 0; i < IM_ARRAYSIZE(actionNames); i++) {
+            ImGui::SameLine();
+            changed |= ImGui::CheckboxFlags(actionNames[i], &trigger.actions, 1 << i);
+        }
+        if (trigger.actions & TRIGGER_COMMAND) {
+            ImGui::SameLine();
+            ImGui::PushItemWidth(200);
+            ImGui::InputTextWithHint("##command", "iocsh command, $(PREFIX) ..", trigger.command, IM_ARRAYSIZE(trigger.command));
+            changed |= ImGui::IsItemDeactivatedAfterEdit();
+            ImGui::PopItemWidth();
+        }
+        ImGui::SameLine();
+        ImGui::PushItemWidth(60);
+        ImGui::DragFloat("s holdoff", &trigger.holdoff, 1.0f, 0.0f, 3600.0f, "%.0f");
+        changed |= ImGui::IsItemDeactivatedAfterEdit();
+        ImGui::PopItemWidth();
+        ImGui::SameLine();
+        if (ImGui::SmallButton("Remove")) {
+            removed = n;
+        }
+        if (trigger.fired) {
+            ImGui::SameLine();
+            ImGui::TextDisabled("fired %zu times", trigger.fired);
+            if (ImGui::IsItemHovered()) {
+                ImGui::SetTooltip("%s", trigger.last);
+            }
+        }
+        ImGui::PopID();
+    }
+    if (ImGui::Button("Add trigger")) {
+        triggers.push_back(Trigger());
+    }
+    if (removed >= 0) {
+        triggers.erase(triggers.begin() + removed);
+        rebuild = true;
+    }
+    if (rebuild) {
+        buildTriggers();
+        changed = true;
+    }
+    if (changed) {
+        saveTriggers();
+    }
+}
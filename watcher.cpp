@@ -0,0 +1,473 @@
+#include "launcher.h"
+
+#include <stdio.h>
+#include <errno.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/inotify.h>
+
+// filesystems where inotify only sees changes made by this host
+#define NFS_SUPER_MAGIC         0x6969
+#define SMB_SUPER_MAGIC         0x517B
+#define CIFS_SUPER_MAGIC        0xFF534D42
+#define SMB2_SUPER_MAGIC        0xFE534D42
+#define FUSE_SUPER_MAGIC        0x65735546
+
+// events we are interested in, per folder level (see IocList::listDir())
+#define WATCH_DIR_MASK          (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR)
+#define WATCH_INSTANCE_MASK     (WATCH_DIR_MASK | IN_CLOSE_WRITE)
+
+bool isNetworkFs(const char * _path) {
+    struct statfs sfs;
+    if (statfs(_path, &sfs) != 0) {
+        E("statfs() %s failed %s\n", _path, strerror(errno));
+        return false;
+    }
+    switch ((unsigned long)sfs.f_type) {
+    case NFS_SUPER_MAGIC:
+    case SMB_SUPER_MAGIC:
+    case CIFS_SUPER_MAGIC:
+    case SMB2_SUPER_MAGIC:
+    case FUSE_SUPER_MAGIC:
+        return true;
+    default:
+        break;
+    }
+    return false;
+}
+
+// is _path equal to _parent or below it
+static bool isBelow(const char * _path, const char * _parent) {
+    size_t len = strlen(_parent);
+    return strncmp(_path, _parent, len) == 0 && (_path[len] == '\0' || _path[len] == '/');
+}
+
+// is _path one of _parents or below one of them; the paths are a few
+// folders deep, every parent of _path is looked up
+bool isBelowAny(const char * _path, const std::unordered_set<std::string> & _parents) {
+    std::string path(_path);
+    while (path.size()) {
+        if (_parents.count(path)) {
+            return true;
+        }
+        size_t slash = path.rfind('/');
+        if (slash == std::string::npos) {
+            break;
+        }
+        path.resize(slash);
+    }
+    return false;
+}
+
+bool IocWatcher::start(bool _polling) {
+    stop();
+
+    polling = _polling;
+    if (! polling) {
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (fd == -1) {
+            E("inotify_init1() failed %s, polling instead\n", strerror(errno));
+            polling = true;
+        }
+    }
+    lastPoll = launcherTime();
+    active = true;
+    D("watching using %s\n", polling ? "polling" : "inotify");
+    return true;
+}
+
+void IocWatcher::stop(void) {
+    for (size_t n = 0; n < watches.size(); n++) {
+        delete watches[n];
+    }
+    watches.clear();
+    byPath.clear();
+    byWd.clear();
+    if (fd != -1) {
+        // closing the descriptor removes all the watches
+        close(fd);
+        fd = -1;
+    }
+    active = false;
+}
+
+IocWatch * IocWatcher::add(const char * _path, int _level) {
+    struct timespec mtime = {0, 0};
+    struct timespec cmdMtime = {0, 0};
+    struct stat st;
+    if (stat(_path, &st) == 0) {
+        mtime = st.st_mtim;
+    }
+    if (_level == 3) {
+        char cmd[1024];
+        snprintf(cmd, sizeof(cmd), "%s/instance.cmd", _path);
+        if (stat(cmd, &st) == 0) {
+            cmdMtime = st.st_mtim;
+        }
+    }
+    return add(_path, _level, mtime, cmdMtime);
+}
+
+// add a watch for folder with already known mtimes (background scan)
+IocWatch * IocWatcher::add(const char * _path, int _level, const struct timespec & _mtime, const struct timespec & _cmdMtime) {
+    if (! active) {
+        return NULL;
+    }
+    IocWatch * watch = find(_path);
+    if (watch) {
+        return watch;
+    }
+
+    watch = new IocWatch(_path, _level);
+    if (! polling) {
+        uint32_t mask = (_level == 3) ? WATCH_INSTANCE_MASK : WATCH_DIR_MASK;
+        watch->wd = inotify_add_watch(fd, _path, mask);
+        if (watch->wd == -1) {
+            // most likely out of watches (fs.inotify.max_user_watches)
+            E("inotify_add_watch() %s failed %s, polling instead\n", _path, strerror(errno));
+            close(fd);
+            fd = -1;
+            polling = true;
+            lastPoll = launcherTime();
+            byWd.clear();
+        } else {
+            byWd[watch->wd] = watch;
+        }
+    }
+    // always remember the times, in case we switch to polling later
+    watch->mtime = _mtime;
+    watch->cmdMtime = _cmdMtime;
+    watches.push_back(watch);
+    byPath[watch->path] = watch;
+    D("[%d] watching %s, wd %d\n", _level, _path, watch->wd);
+    return watch;
+}
+
+// drop the watch from the lookups, the kernel already removed it or is
+// told to
+void IocWatcher::forget(IocWatch * _watch) {
+    if (_watch->wd != -1) {
+        // a folder reached through a link shares the descriptor
+        auto it = byWd.find(_watch->wd);
+        if (it != byWd.end() && it->second == _watch) {
+            byWd.erase(it);
+        }
+        if (fd != -1) {
+            // fails with EINVAL if kernel already removed the watch
+            inotify_rm_watch(fd, _watch->wd);
+        }
+        _watch->wd = -1;
+    }
+    byPath.erase(_watch->path);
+}
+
+// stop watching _path and all the folders below it
+void IocWatcher::remove(const char * _path) {
+    size_t kept = 0;
+    for (size_t n = 0; n < watches.size(); n++) {
+        IocWatch * watch = watches[n];
+        if (isBelow(watch->path, _path)) {
+            D("[%d] not watching %s, wd %d\n", watch->level, watch->path, watch->wd);
+            forget(watch);
+            delete watch;
+            continue;
+        }
+        watches[kept++] = watch;
+    }
+    watches.resize(kept);
+}
+
+// same for a number of folders, in one pass
+void IocWatcher::remove(const std::unordered_set<std::string> & _paths) {
+    size_t kept = 0;
+    for (size_t n = 0; n < watches.size(); n++) {
+        IocWatch * watch = watches[n];
+        if (isBelowAny(watch->path, _paths)) {
+            D("[%d] not watching %s, wd %d\n", watch->level, watch->path, watch->wd);
+            forget(watch);
+            delete watch;
+            continue;
+        }
+        watches[kept++] = watch;
+    }
+    watches.resize(kept);
+}
+
+// process the pending changes in the IOC roots, without walking the trees
+// in the main thread; returns the number of changes seen
+size_t IocList::update(void) {
+    PROFILE_ZONE("IocList::update");
+    size_t changes = 0;
+    double now = launcherTime();
+
+    for (size_t n = 0; n < roots.size(); n++) {
+        IocRoot * root = roots[n];
+        if (root->scan && root->scan->done) {
+            size_t applied = applyScan(root, root->scan);
+            changes += applied;
+            root->scan->release();
+            root->scan = NULL;
+            root->lastScan = now;
+            cacheDirty = cacheDirty || applied;
+        }
+        if (! root->scan && root->lastScan > 0.0 && root->periodic() &&
+            now - root->lastScan >= root->scanPeriod) {
+            // mounts we can not watch are walked in the background
+            startScan(root);
+        }
+        if (! root->watcher.active) {
+            continue;
+        }
+
+        if (root->watcher.fd != -1) {
+            changes += handleEvents(root);
+        }
+        if (root->watcher.polling) {
+            if (now - root->watcher.lastPoll >= root->watcher.pollPeriod) {
+                root->watcher.lastPoll = now;
+                changes += pollChanges(root);
+            }
+        }
+    }
+
+    if (haveStale) {
+        size_t dropped = dropStale();
+        changes += dropped;
+        cacheDirty = cacheDirty || dropped;
+    }
+    if (changes) {
+        // per root counts shown in the roots table
+        for (size_t n = 0; n < roots.size(); n++) {
+            roots[n]->iocs = 0;
+        }
+        for (size_t n = 0; n < list.size(); n++) {
+            if (list[n]->root) {
+                list[n]->root->iocs++;
+            }
+        }
+    }
+    if (cacheDirty) {
+        bool scanning = false;
+        for (size_t n = 0; n < roots.size(); n++) {
+            scanning = scanning || roots[n]->scan;
+        }
+        // once all the roots are in, partial results are not worth saving
+        if (! scanning) {
+            saveCache();
+            cacheDirty = false;
+        }
+    }
+    return changes;
+}
+
+size_t IocList::handleEvents(IocRoot * _root) {
+    PROFILE_ZONE("handleEvents");
+    IocWatcher & watcher = _root->watcher;
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    size_t changes = 0;
+
+    while (watcher.fd != -1) {
+        ssize_t len = read(watcher.fd, buf, sizeof(buf));
+        if (len == -1) {
+            if (errno != EAGAIN) {
+                E("read() inotify failed %s\n", strerror(errno));
+            }
+            break;
+        }
+        if (len == 0) {
+            break;
+        }
+
+        for (char * p = buf; p < buf + len; ) {
+            struct inotify_event * ev = (struct inotify_event *)p;
+            p += sizeof(struct inotify_event) + ev->len;
+
+            if (ev->mask & IN_Q_OVERFLOW) {
+                // we lost track of changes; walk the whole tree once again
+                E("inotify queue overflow, rescanning %s\n", _root->path);
+                watcher.stop();
+                startScan(_root);
+                changes++;
+                // remaining events refer to the old watches
+                break;
+            }
+
+            IocWatch * watch = watcher.find(ev->wd);
+            if (! watch) {
+                continue;
+            }
+            if (ev->mask & IN_IGNORED) {
+                // the folder was removed, kernel dropped the watch
+                watcher.byWd.erase(ev->wd);
+                watch->wd = -1;
+                continue;
+            }
+            if (ev->len == 0) {
+                continue;
+            }
+
+            char path[1024];
+            snprintf(path, sizeof(path), "%s/%s", watch->path, ev->name);
+            D("[%d] event 0x%08X %s\n", watch->level, ev->mask, path);
+
+            // symlinked stages and folders come without IN_ISDIR
+            bool isDir = ev->mask & IN_ISDIR;
+            if (! isDir && watch->level < 3) {
+                struct stat st;
+                if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    isDir = watcher.find(path) != NULL;
+                } else if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    isDir = stat(path, &st) == 0 && S_ISDIR(st.st_mode);
+                }
+            }
+
+            if (isDir) {
+                if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    // stage, ioc/ or instance folder is gone
+                    watcher.remove(path);
+                    changes += removeIocs(path);
+                } else if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+                    // walk only the new sub-tree
+                    if (wantDir(ev->name, watch->level)) {
+                        size_t before = count();
+                        listDir(_root, path, watch->level + 1);
+                        changes += count() - before;
+                    }
+                }
+            } else if (watch->level == 3 && strcmp(ev->name, "instance.cmd") == 0) {
+                if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                    changes += removeIocs(watch->path);
+                } else if (ev->mask & (IN_CLOSE_WRITE | IN_MOVED_TO)) {
+                    if (! parseInstanceFile(_root, watch->path, ev->name)) {
+                        // edited into something we can not use
+                        removeIocs(watch->path);
+                    }
+                    changes++;
+                }
+            }
+        }
+    }
+
+    return changes;
+}
+
+// compare the folder and instance.cmd mtimes with the ones we remember;
+// only the folders that changed are listed again
+size_t IocList::pollChanges(IocRoot * _root) {
+    PROFILE_ZONE("pollChanges");
+    IocWatcher & watcher = _root->watcher;
+    size_t changes = 0;
+    struct stat st;
+
+    // rescanning adds and removes watches, iterate over a copy of the paths
+    std::vector<char *> paths;
+    engine.nextGeneration();
+    for (size_t n = 0; n < watcher.watches.size(); n++) {
+        paths.push_back(strdup(watcher.watches[n]->path));
+    }
+
+    for (size_t n = 0; n < paths.size(); n++) {
+        IocWatch * watch = watcher.find(paths[n]);
+        if (! watch) {
+            // removed while rescanning its parent
+            continue;
+        }
+        if (stat(watch->path, &st) != 0) {
+            // parent folder rescan will take care of it
+            continue;
+        }
+        if (! sameMtime(st.st_mtim, watch->mtime)) {
+            if (watch->level < 3) {
+                // the new mtime is taken once the folder could be listed
+                changes += rescanDir(_root, watch, st.st_mtim);
+                continue;
+            }
+            watch->mtime = st.st_mtim;
+        }
+        if (watch->level == 3) {
+            // editing instance.cmd does not change the folder mtime
+            char cmd[1024];
+            snprintf(cmd, sizeof(cmd), "%s/instance.cmd", watch->path);
+            if (stat(cmd, &st) != 0) {
+                memset(&st, 0, sizeof(st));
+            }
+            if (! sameMtime(st.st_mtim, watch->cmdMtime)) {
+                watch->cmdMtime = st.st_mtim;
+                if (st.st_mtim.tv_sec == 0 || ! parseInstanceFile(_root, watch->path, "instance.cmd")) {
+                    removeIocs(watch->path);
+                }
+                changes++;
+            }
+        }
+    }
+
+    for (size_t n = 0; n < paths.size(); n++) {
+        free(paths[n]);
+    }
+    return changes;
+}
+
+// list a single folder that changed, pick up new sub-folders and
+// forget the ones that are gone; a folder that can not be listed is left
+// as it is, with its old mtime, for the next poll
+size_t IocList::rescanDir(IocRoot * _root, IocWatch * _watch, const struct timespec & _mtime) {
+    PROFILE_ZONE("rescanDir");
+    IocWatcher & watcher = _root->watcher;
+    DIR * dir;
+    size_t changes = 0;
+    int level = _watch->level;
+    char * path = strdup(_watch->path);
+
+    D("[%d] rescan %s\n", level, path);
+    std::vector<std::string> subs;
+    std::unordered_set<std::string> seen;
+    if ((dir = opendir(path))) {
+        std::vector<IocDirEntry> entries;
+        readDirEntries(dir, entries, NULL);
+        closedir(dir);
+        for (size_t n = 0; n < entries.size(); n++) {
+            if (entries[n].type != DT_DIR || ! wantDir(entries[n].name, level)) {
+                continue;
+            }
+            char sub[1024];
+            snprintf(sub, sizeof(sub), "%s/%s", path, entries[n].name);
+            subs.push_back(sub);
+            seen.insert(sub);
+        }
+    } else if (errno != ENOENT && errno != ENOTDIR) {
+        // EACCES on a stage being deployed, EIO or ESTALE on NFS
+        D("[%d] can not list %s %s\n", level, path, strerror(errno));
+        free(path);
+        return 0;
+    }
+    _watch->mtime = _mtime;
+
+    // folders that are gone, all of them removed in one pass
+    std::unordered_set<std::string> gone;
+    size_t len = strlen(path);
+    for (size_t n = 0; n < watcher.watches.size(); n++) {
+        IocWatch * watch = watcher.watches[n];
+        if (watch->level == level + 1 && strncmp(watch->path, path, len) == 0 && watch->path[len] == '/' &&
+            ! seen.count(watch->path)) {
+            gone.insert(watch->path);
+        }
+    }
+    if (gone.size()) {
+        watcher.remove(gone);
+        changes += removeIocs(gone) + gone.size();
+    }
+
+    // new folders
+    for (size_t n = 0; n < subs.size(); n++) {
+        if (! watcher.find(subs[n].c_str())) {
+            size_t before = count();
+            listDir(_root, subs[n].c_str(), level + 1);
+            changes += count() - before + 1;
+        }
+    }
+
+    free(path);
+    return changes;
+}